@@ -0,0 +1,34 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "translator/byte_array_util.h"
+#include "translator/model_package.h"
+#include "translator/parser.h"
+
+// Packs the files a model configuration refers to, along with the configuration, into a single model package. Or, with
+// --validate, checks a package.
+int main(int argc, char *argv[]) {
+  using namespace marian::bergamot;
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <model-config.yml> <package>\n"
+              << "       " << argv[0] << " --validate <package>" << std::endl;
+    return 1;
+  }
+
+  if (std::string(argv[1]) == "--validate") {
+    bool valid = validateModelPackage(argv[2]);
+    std::cout << argv[2] << (valid ? ": valid" : ": invalid") << std::endl;
+    return valid ? 0 : 1;
+  }
+
+  std::string configPath = argv[1];
+  auto options = parseOptionsFromFilePath(configPath);
+  MemoryBundle memory = getMemoryBundleFromConfig(options);
+
+  std::ifstream configFile(configPath);
+  std::stringstream config;
+  config << configFile.rdbuf();
+  writeModelPackage(argv[2], config.str(), memory);
+  return 0;
+}
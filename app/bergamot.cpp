@@ -13,25 +13,18 @@ int main(int argc, char *argv[]) {
 
   AsyncService service(config.serviceConfig);
 
-  // Construct a model.
+  // Construct a model, while the input is read.
   auto options = parseOptionsFromFilePath(config.modelConfigPaths.front());
-
-  auto model = marian::New<TranslationModel>(options);
+  auto loading = TranslationModel::loadAsync(options);
 
   ResponseOptions responseOptions;
   std::string input = readFromStdin();
 
-  // Create a barrier using future/promise.
-  std::promise<Response> promise;
-  std::future<Response> future = promise.get_future();
-  auto callback = [&promise](Response &&response) {
-    // Fulfill promise.
-    promise.set_value(std::move(response));
-  };
+  std::shared_ptr<TranslationModel> model = loading.get();
 
-  service.translate(model, std::move(input), callback, responseOptions);
+  std::future<Response> future = service.translate(model, std::move(input), responseOptions);
 
-  // Wait until promise sets the response.
+  // Wait until the response is available.
   Response response = future.get();
 
   // Print (only) translated text.
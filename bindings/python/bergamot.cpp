@@ -53,33 +53,19 @@ class ServicePyAdapter {
       inputs.push_back(py::str(handle));
     }
 
-    // Prepare promises, save respective futures. Have callback's in async set
-    // value to the promises.
-    std::vector<std::future<Response>> futures;
-    std::vector<std::promise<Response>> promises;
-    promises.resize(inputs.size());
-
     ResponseOptions options;
     options.HTML = html;
     options.qualityScores = qualityScores;
     options.alignment = alignment;
+    std::vector<ResponseOptions> responseOptions(inputs.size(), options);
 
-    for (size_t i = 0; i < inputs.size(); i++) {
-      auto callback = [&promises, i](Response &&response) { promises[i].set_value(std::move(response)); };
-
-      service_.translate(model, std::move(inputs[i]), std::move(callback), options);
-
-      futures.push_back(std::move(promises[i].get_future()));
-    }
-
-    // Wait on all futures to be ready.
-    std::vector<Response> responses;
-    for (size_t i = 0; i < futures.size(); i++) {
-      futures[i].wait();
-      responses.push_back(std::move(futures[i].get()));
-    }
+    // Submit all texts as a group, and wait on the group to complete.
+    std::promise<std::vector<Response>> promise;
+    std::future<std::vector<Response>> future = promise.get_future();
+    auto callback = [&promise](std::vector<Response> &&responses) { promise.set_value(std::move(responses)); };
+    service_.translateMultiple(model, std::move(inputs), std::move(callback), responseOptions);
 
-    return responses;
+    return future.get();
   }
 
   std::vector<Response> pivot(Model first, Model second, py::list &texts, bool html, bool qualityScores,
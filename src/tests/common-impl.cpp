@@ -14,17 +14,9 @@ Response Bridge<BlockingService>::translate(BlockingService &service, std::share
 
 Response Bridge<AsyncService>::translate(AsyncService &service, std::shared_ptr<TranslationModel> &model,
                                          std::string &&source, const ResponseOptions &responseOptions) {
-  // downgrade to blocking via promise, future, wait and return response;
-  std::promise<Response> responsePromise;
-  std::future<Response> responseFuture = responsePromise.get_future();
-
-  auto callback = [&responsePromise](Response &&response) { responsePromise.set_value(std::move(response)); };
-  service.translate(model, std::move(source), callback, responseOptions);
-
-  responseFuture.wait();
-
-  Response response = responseFuture.get();
-  return response;
+  // downgrade to blocking via future, wait and return response;
+  std::future<Response> responseFuture = service.translate(model, std::move(source), responseOptions);
+  return responseFuture.get();
 }
 
 Response Bridge<BlockingService>::pivot(BlockingService &service, std::shared_ptr<TranslationModel> &sourceToPivot,
@@ -38,14 +30,9 @@ Response Bridge<BlockingService>::pivot(BlockingService &service, std::shared_pt
 Response Bridge<AsyncService>::pivot(AsyncService &service, std::shared_ptr<TranslationModel> &sourceToPivot,
                                      std::shared_ptr<TranslationModel> &pivotToTarget, std::string &&source,
                                      const ResponseOptions &responseOptions) {
-  std::promise<Response> responsePromise;
-  std::future<Response> responseFuture = responsePromise.get_future();
-
-  auto callback = [&responsePromise](Response &&response) { responsePromise.set_value(std::move(response)); };
-  service.pivot(sourceToPivot, pivotToTarget, std::move(source), callback, responseOptions);
-  responseFuture.wait();
-  Response response = responseFuture.get();
-  return response;
+  std::future<Response> responseFuture =
+      service.pivot(sourceToPivot, pivotToTarget, std::move(source), responseOptions);
+  return responseFuture.get();
 }
 
 template <class Service>
@@ -71,6 +58,12 @@ void TestSuite<Service>::TestSuite::run(const std::string &opModeAsString, std::
     qualityEstimatorScores(models.front());
   } else if (opModeAsString == "test-translation-cache") {
     translationCache(models.front());
+  } else if (opModeAsString == "test-sentence-streaming") {
+    sentenceStreaming(models.front());
+  } else if (opModeAsString == "test-warmup") {
+    warmup(models.front());
+  } else if (opModeAsString == "test-load-async") {
+    loadAsync(models);
   } else if (opModeAsString == "test-pivot") {
     pivotTranslate(models);
   } else if (opModeAsString == "test-pivot-with-html") {
@@ -231,6 +224,98 @@ void TestSuite<Service>::translationCache(Ptr<TranslationModel> model) {
   std::cout << firstResponse.target.text;
 }
 
+template <class Service>
+void TestSuite<Service>::sentenceStreaming(Ptr<TranslationModel> model) {
+  const std::string source = readFromStdin();
+
+  // Twice, so that with a cache the second round streams sentences found in it.
+  for (size_t round = 0; round < 2; round++) {
+    // Sentences are delivered one at a time, and all of them ahead of the Response.
+    std::vector<std::optional<std::string>> streamed;
+    ResponseOptions responseOptions;
+    responseOptions.sentenceCallback = [&streamed](size_t sentenceIdx, std::string &&translation) {
+      if (streamed.size() <= sentenceIdx) {
+        streamed.resize(sentenceIdx + 1);
+      }
+      ABORT_IF(streamed[sentenceIdx], "Sentence {} streamed more than once", sentenceIdx);
+      streamed[sentenceIdx] = std::move(translation);
+    };
+
+    std::string buffer = source;
+    Response response = bridge_.translate(service_, model, std::move(buffer), responseOptions);
+    ABORT_IF(streamed.size() != response.target.numSentences(), "Expected {} sentences streamed, got {}",
+             response.target.numSentences(), streamed.size());
+    for (size_t sentenceIdx = 0; sentenceIdx < streamed.size(); sentenceIdx++) {
+      ABORT_IF(!streamed[sentenceIdx], "Sentence {} not streamed", sentenceIdx);
+      ABORT_IF(*streamed[sentenceIdx] != response.target.sentence(sentenceIdx),
+               "Sentence {} streamed differs from the one in the Response", sentenceIdx);
+    }
+
+    if (round == 0) {
+      std::cout << response.target.text;
+    }
+  }
+}
+
+template <class Service>
+void TestSuite<Service>::warmup(Ptr<TranslationModel> model) {
+  const std::string source = readFromStdin();
+
+  // Warmup without translation creates every replica of the backend there is to create, which warmup with translation
+  // and translation after find in place.
+  size_t unreplicatedBytes = model->residentBytes();
+  service_.warmup(model, /*translate=*/false);
+  size_t residentBytes = model->residentBytes();
+  service_.warmup(model, /*translate=*/true);
+  ABORT_IF(model->residentBytes() != residentBytes, "Warmup with translation created replicas of its own");
+
+  // Workers retired free the replicas warmup created for them, and workers spawned in their place, with the same ids,
+  // create replicas of their own. Replicas mapping their parameters from memory are not accounted in residentBytes.
+  if constexpr (std::is_same_v<Service, AsyncService>) {
+    size_t numWorkers = service_.numWorkers();
+    if (numWorkers > 1) {
+      service_.setNumWorkers(1);
+      ABORT_IF(residentBytes != unreplicatedBytes && model->residentBytes() >= residentBytes,
+               "Retired workers kept their replicas");
+      service_.setNumWorkers(numWorkers);
+      service_.warmup(model, /*translate=*/true);
+      ABORT_IF(model->residentBytes() != residentBytes, "Workers respawned did not create replicas of their own");
+    }
+  }
+
+  ResponseOptions responseOptions;
+  std::string buffer = source;
+  Response response = bridge_.translate(service_, model, std::move(buffer), responseOptions);
+  ABORT_IF(model->residentBytes() != residentBytes, "Translation after warmup created replicas of its own");
+  std::cout << response.target.text;
+}
+
+template <class Service>
+void TestSuite<Service>::loadAsync(std::vector<Ptr<TranslationModel>> &models) {
+  const std::string source = readFromStdin();
+
+  // All at once, as a client loading several models would.
+  std::vector<std::future<std::unique_ptr<TranslationModel>>> loading;
+  for (Ptr<TranslationModel> &model : models) {
+    loading.push_back(TranslationModel::loadAsync(model->options()));
+  }
+
+  ResponseOptions responseOptions;
+  for (size_t i = 0; i < models.size(); i++) {
+    Ptr<TranslationModel> loaded = loading[i].get();
+    std::string buffer = source;
+    Response expected = bridge_.translate(service_, models[i], std::move(buffer), responseOptions);
+    buffer = source;
+    Response response = bridge_.translate(service_, loaded, std::move(buffer), responseOptions);
+    ABORT_IF(response.target.text != expected.target.text,
+             "Model {} loaded asynchronously translates differently from the one constructed sequentially", i);
+
+    if (i == 0) {
+      std::cout << response.target.text;
+    }
+  }
+}
+
 template <class Service>
 void TestSuite<Service>::pivotTranslateWithHTML(std::vector<Ptr<TranslationModel>> &models) {
   ABORT_IF(models.size() != 2, "Forward and backward test needs two models.");
@@ -3,8 +3,12 @@
 #include <cstdlib>
 #include <future>
 #include <iostream>
+#include <optional>
 #include <sstream>
+#include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 #include "common/definitions.h"
 #include "common/timer.h"
@@ -86,6 +90,20 @@ class TestSuite {
 
   void translationCache(Ptr<TranslationModel> model);
 
+  // Reads from stdin and translates the read content twice, streaming sentences. Checks that every sentence is streamed
+  // once, as it is in the Response. Prints the translated text.
+  void sentenceStreaming(Ptr<TranslationModel> model);
+
+  // Reads from stdin, warms model up and translates the read content. Checks that warmup with translation, and
+  // translation after, create no replicas of the backend beyond those warmup without translation does, and with an
+  // AsyncService, that shrinking and growing the workers frees and recreates them. Prints the translated text.
+  void warmup(Ptr<TranslationModel> model);
+
+  // Reads from stdin and translates the read content with each of models, and with a copy of each loaded concurrently
+  // through TranslationModel::loadAsync(...). Checks that the translations match. Prints the translated text of the
+  // first model.
+  void loadAsync(std::vector<Ptr<TranslationModel>> &models);
+
   void pivotTranslate(std::vector<Ptr<TranslationModel>> &models);
 
   void pivotTranslateWithHTML(std::vector<Ptr<TranslationModel>> &models);
@@ -0,0 +1,60 @@
+#include <set>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "catch.hpp"
+#include "translator/affinity.h"
+
+using namespace marian::bergamot;
+
+TEST_CASE("Test parsing of cpu lists") {
+  REQUIRE(parseCpuList("0") == std::vector<size_t>{0});
+  REQUIRE(parseCpuList("0-3") == std::vector<size_t>{0, 1, 2, 3});
+  REQUIRE(parseCpuList("0-1,4,6-7\n") == std::vector<size_t>{0, 1, 4, 6, 7});
+  REQUIRE(parseCpuList("").empty());
+  REQUIRE(parseCpuList("\n").empty());
+}
+
+#if defined(__linux__)
+TEST_CASE("Test pinning a thread to a cpu") {
+  CHECK(!pinCurrentThread({}));
+
+  // On a thread of its own, so that the test runner is left unpinned. Assertions are left to the test runner.
+  cpu_set_t allowed;
+  REQUIRE(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+  size_t cpu = 0;
+  while (!CPU_ISSET(cpu, &allowed)) {
+    cpu++;
+  }
+
+  bool pinned = false;
+  cpu_set_t affinity;
+  CPU_ZERO(&affinity);
+  int runningOn = -1;
+  std::thread thread([&]() {
+    pinned = pinCurrentThread({cpu});
+    sched_getaffinity(0, sizeof(affinity), &affinity);
+    runningOn = sched_getcpu();
+  });
+  thread.join();
+
+  REQUIRE(pinned);
+  CHECK(CPU_COUNT(&affinity) == 1);
+  CHECK(CPU_ISSET(cpu, &affinity));
+  CHECK(runningOn == static_cast<int>(cpu));
+}
+
+TEST_CASE("Test NUMA nodes have cpus of their own") {
+  std::set<size_t> seen;
+  for (const std::vector<size_t> &cpus : numaNodeCpus()) {
+    CHECK(!cpus.empty());
+    for (size_t cpu : cpus) {
+      CHECK(seen.insert(cpu).second);
+    }
+  }
+}
+#endif
@@ -0,0 +1,107 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+#include "test_models.h"
+#include "translator/batch_dispatcher.h"
+#include "translator/service.h"
+#include "translator/threadsafe_batching_pool.h"
+
+using namespace marian::bergamot;
+
+TEST_CASE("Test BatchDispatcher forms a batch only for an idle worker at no batches queued") {
+  // Batches go through a pool and dispatcher as in AsyncService, with the test thread as the only worker, completing
+  // batches without translating them.
+  TestModels models;
+  auto model = models.model(/*miniBatchWords=*/16);
+  ThreadsafeBatchingPool<AggregateBatchingPool> pool;
+  BatchDispatcher dispatcher(/*capacity=*/1, /*numWorkers=*/1, /*maxQueuedPerWorker=*/0);
+
+  std::vector<std::string> order;
+  auto labelled = [&order](const std::string &label) {
+    return [&order, label](Response &&) { order.push_back(label); };
+  };
+
+  // A sentence of 16 words fills a batch.
+  for (const std::string &label : {"first", "second", "third"}) {
+    pool.enqueueRequest(model, models.request(model, {16}, labelled(label)));
+  }
+
+  std::thread batchFormer([&pool, &dispatcher]() {
+    Batch batch;
+    std::shared_ptr<TranslationModel> batchModel;
+    while (dispatcher.waitForRoom() && pool.generateBatch(batchModel, batch)) {
+      dispatcher.dispatch(std::move(batchModel), std::move(batch));
+    }
+    dispatcher.shutdown();
+  });
+
+  Workspace workspace(/*deviceId=*/0, /*workspaceSizeInMB=*/1);
+  Batch batch;
+  std::shared_ptr<TranslationModel> batchModel;
+  REQUIRE(dispatcher.next(/*workerId=*/0, workspace, batchModel, batch));
+
+  // Comes in while the worker has the first batch in hand. The next batch is formed only once the worker is done, and
+  // therefore takes the urgent request ahead of the others, which were pending before it.
+  ResponseOptions urgent;
+  urgent.priority = 1;
+  pool.enqueueRequest(model, models.request(model, {16}, labelled("urgent"), urgent));
+
+  for (size_t i = 0; i < 4; i++) {
+    TestModels::drop(batch);
+    pool.releaseBatch(batchModel);
+    batchModel = nullptr;
+    batch.clear();
+    if (i < 3) {
+      REQUIRE(dispatcher.next(/*workerId=*/0, workspace, batchModel, batch));
+    }
+  }
+  CHECK(order == std::vector<std::string>{"first", "urgent", "second", "third"});
+
+  pool.shutdown();
+  CHECK(!dispatcher.next(/*workerId=*/0, workspace, batchModel, batch));
+  batchFormer.join();
+}
+
+TEST_CASE("Test BatchDispatcher runs every task posted to a worker before it retires, and turns down the rest") {
+  BatchDispatcher dispatcher(/*capacity=*/2, /*numWorkers=*/2, /*maxQueuedPerWorker=*/1);
+  std::atomic<size_t> run{0};
+  auto task = [&run](Workspace &) { ++run; };
+  auto spawn = [&dispatcher]() {
+    return std::thread([&dispatcher]() {
+      Workspace workspace(/*deviceId=*/1, /*workspaceSizeInMB=*/1);
+      Batch batch;
+      std::shared_ptr<TranslationModel> batchModel;
+      while (dispatcher.next(/*workerId=*/1, workspace, batchModel, batch)) {
+      }
+    });
+  };
+  std::thread worker = spawn();
+
+  // Posts race with the worker retiring, as those of AsyncService::translateMultiple with a shrink do.
+  size_t posted = 0;
+  std::thread poster([&dispatcher, &task, &posted]() {
+    while (dispatcher.post(/*workerId=*/1, task)) {
+      ++posted;
+    }
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  dispatcher.resize(1);
+  poster.join();
+  worker.join();
+  CHECK(posted > 0);
+  CHECK(run == posted);
+  CHECK(!dispatcher.post(/*workerId=*/1, task));
+
+  // Taken again for a worker spawned after growing back, which runs them even if shut down right away.
+  dispatcher.resize(2);
+  REQUIRE(dispatcher.post(/*workerId=*/1, task));
+  worker = spawn();
+  dispatcher.shutdown();
+  worker.join();
+  CHECK(run == posted + 1);
+}
@@ -0,0 +1,461 @@
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+#include "test_models.h"
+#include "translator/aggregate_batching_pool.h"
+#include "translator/batching_pool.h"
+#include "translator/parser.h"
+#include "translator/threadsafe_batching_pool.h"
+
+using namespace marian::bergamot;
+
+namespace {
+
+// Batches of up to 16 words, which take two sentences of 8.
+constexpr size_t kMiniBatchWords = 16;
+
+std::shared_ptr<marian::Options> options(const std::string &extra = "") {
+  return parseOptionsFromString(TestModels::config(kMiniBatchWords, extra), /*validate=*/false);
+}
+
+// Lengths of the sentences in batch, in order of batching.
+std::vector<size_t> lengths(Batch &batch) {
+  std::vector<size_t> lengths;
+  for (const RequestSentence &sentence : batch.sentences()) {
+    lengths.push_back(sentence.numTokens());
+  }
+  return lengths;
+}
+
+ResponseOptions priority(int priority) {
+  ResponseOptions options;
+  options.priority = priority;
+  return options;
+}
+
+// Generates batches from pool until it is empty, completing them right away. Returns the lengths in each.
+std::vector<std::vector<size_t>> drain(BatchingPool &pool) {
+  std::vector<std::vector<size_t>> batches;
+  Batch batch;
+  while (pool.generateBatch(batch) > 0) {
+    batches.push_back(lengths(batch));
+    TestModels::drop(batch);
+  }
+  return batches;
+}
+
+void complete(RequestSentences &sentences) {
+  for (RequestSentence &sentence : sentences) {
+    sentence.completeSentence(/*history=*/nullptr);
+  }
+}
+
+}  // namespace
+
+TEST_CASE("Test BatchingPool anchors a batch at the most urgent sentence") {
+  TestModels models;
+  auto model = models.model(kMiniBatchWords);
+  BatchingPool pool(options());
+
+  auto ignore = [](Response &&) {};
+  pool.enqueueRequest(models.request(model, {2, 2}, ignore));
+  pool.enqueueRequest(models.request(model, {12}, ignore, priority(1)));
+
+  // The urgent sentence does not leave room for another, however short.
+  CHECK(drain(pool) == std::vector<std::vector<size_t>>{{12}, {2, 2}});
+}
+
+TEST_CASE("Test BatchingPool fills a batch with sentences closest in predicted length to the anchor") {
+  TestModels models;
+  auto model = models.model(kMiniBatchWords);
+  BatchingPool pool(options());
+
+  // Without translations observed, target lengths are predicted to be those of the source. Sentences arrive in order,
+  // each in a request of its own.
+  auto ignore = [](Response &&) {};
+  for (size_t length : {8, 2, 7, 4, 3}) {
+    pool.enqueueRequest(models.request(model, {length}, ignore));
+  }
+
+  // A batch of 8 has room for one more row, taken by 7. The next batch is anchored at 2, the earliest left, and padded
+  // to 4 it takes the rest: 3 as the closest, then 4.
+  CHECK(drain(pool) == std::vector<std::vector<size_t>>{{8, 7}, {2, 3, 4}});
+}
+
+TEST_CASE("Test OutputLengthEstimator predicts from the ratios of target to source length observed") {
+  OutputLengthEstimator estimator;
+  std::vector<size_t> predicted;
+  estimator.predict(4, predicted);
+  CHECK(predicted == std::vector<size_t>{0, 1, 2, 3, 4});
+
+  // A length observed often enough goes by its own ratio, others by the ratio overall.
+  for (size_t i = 0; i < 8; i++) {
+    estimator.observe(4, 12);
+  }
+  estimator.observe(2, 2);
+  estimator.predict(4, predicted);
+  CHECK(predicted == std::vector<size_t>{0, 3, 6, 8, 12});
+}
+
+TEST_CASE("Test BatchingPool budgets source words, and predicted target words only if asked to") {
+  TestModels models;
+  auto model = models.model(kMiniBatchWords);
+
+  // Translations are observed to come out twice as long as their source.
+  auto batches = [&](const std::string &extra) {
+    BatchingPool pool(options(extra));
+    pool.outputLength().observe(8, 16);
+    auto ignore = [](Response &&) {};
+    pool.enqueueRequest(models.request(model, {8}, ignore));
+    pool.enqueueRequest(models.request(model, {8}, ignore));
+    return drain(pool);
+  };
+
+  CHECK(batches("") == std::vector<std::vector<size_t>>{{8, 8}});
+  CHECK(batches("budget-target-words: true\n") == std::vector<std::vector<size_t>>{{8}, {8}});
+}
+
+TEST_CASE("Test BatchingPool bounds the batches a sentence is passed over by") {
+  TestModels models;
+  auto model = models.model(kMiniBatchWords);
+
+  // Order in which requests are batched, one to a batch as a sentence of 16 words fills it, given options in extra. A
+  // request of low priority arrives first, ahead of three more urgent.
+  auto batched = [&](const std::string &extra) {
+    BatchingPool pool(options(extra));
+    std::vector<std::string> order;
+    auto labelled = [&order](const std::string &label) {
+      return [&order, label](Response &&) { order.push_back(label); };
+    };
+
+    pool.enqueueRequest(models.request(model, {16}, labelled("low")));
+    for (const std::string &label : {"urgent1", "urgent2", "urgent3"}) {
+      pool.enqueueRequest(models.request(model, {16}, labelled(label), priority(1)));
+    }
+    drain(pool);
+    return order;
+  };
+
+  CHECK(batched("max-batches-passed-over: 2\n") ==
+        std::vector<std::string>{"urgent1", "urgent2", "low", "urgent3"});
+  CHECK(batched("max-batches-passed-over: 0\n") ==
+        std::vector<std::string>{"urgent1", "urgent2", "urgent3", "low"});
+}
+
+TEST_CASE("Test BatchingPool drops a cancelled request wherever its sentences are") {
+  TestModels models;
+  auto model = models.model(kMiniBatchWords);
+  BatchingPool pool(options());
+
+  std::vector<Response::Status> statuses;
+  auto callback = [&statuses](Response &&response) { statuses.push_back(response.status); };
+  RequestHandle handle;
+  pool.enqueueRequest(models.request(model, {8, 4}, callback));
+  pool.enqueueRequest(models.request(model, {8, 4}, callback, ResponseOptions(), handle));
+  REQUIRE(pool.stats().sentences == 4);
+
+  // Sentences of the cancelled request are behind those of the first in their buckets, and still leave the account of
+  // pending work straight away.
+  handle.cancel();
+  pool.dropCancelled();
+  CHECK(pool.stats().sentences == 2);
+  CHECK(pool.stats().words == 12);
+
+  RequestSentences cancelled;
+  pool.takeCancelled(cancelled);
+  REQUIRE(cancelled.size() == 2);
+  complete(cancelled);
+  CHECK(statuses == std::vector<Response::Status>{Response::CANCELLED});
+
+  Batch batch;
+  CHECK(pool.generateBatch(batch) == 2);
+  CHECK(pool.stats().sentences == 0);
+  TestModels::drop(batch);
+}
+
+TEST_CASE("Test BatchingPool drops requests cancelled before they are enqueued, and only in their own pool") {
+  TestModels models;
+  auto model = models.model(kMiniBatchWords);
+  BatchingPool pool(options());
+  BatchingPool other(options());
+
+  RequestHandle handle;
+  pool.enqueueRequest(models.request(model, {8}, [](Response &&) {}));
+  other.enqueueRequest(models.request(model, {8}, [](Response &&) {}));
+  handle.cancel();
+  pool.enqueueRequest(models.request(model, {8}, [](Response &&) {}, ResponseOptions(), handle));
+  REQUIRE(pool.stats().sentences == 2);
+
+  // Behind the sentence of the first request, yet dropped on the next look.
+  pool.dropCancelled();
+  CHECK(pool.stats().sentences == 1);
+  other.dropCancelled();
+  CHECK(other.stats().sentences == 1);
+
+  RequestSentences cancelled;
+  pool.takeCancelled(cancelled);
+  REQUIRE(cancelled.size() == 1);
+  complete(cancelled);
+  other.takeCancelled(cancelled);
+  CHECK(cancelled.size() == 1);
+  drain(pool);
+  drain(other);
+}
+
+TEST_CASE("Test BatchingPool completes a request cancelled in translation once its batch completes") {
+  TestModels models;
+  auto model = models.model(kMiniBatchWords);
+  BatchingPool pool(options());
+
+  std::vector<Response::Status> statuses;
+  auto callback = [&statuses](Response &&response) { statuses.push_back(response.status); };
+  RequestHandle handle;
+  pool.enqueueRequest(models.request(model, {8, 8, 8}, callback, ResponseOptions(), handle));
+
+  Batch batch;
+  REQUIRE(pool.generateBatch(batch) == 2);
+  handle.cancel();
+  pool.dropCancelled();
+  CHECK(pool.stats().sentences == 0);
+
+  RequestSentences cancelled;
+  pool.takeCancelled(cancelled);
+  REQUIRE(cancelled.size() == 1);
+  complete(cancelled);
+  CHECK(statuses.empty());
+
+  TestModels::drop(batch);
+  CHECK(statuses == std::vector<Response::Status>{Response::CANCELLED});
+}
+
+TEST_CASE("Test BatchingPool ignores cancellation of a completed request") {
+  TestModels models;
+  auto model = models.model(kMiniBatchWords);
+  BatchingPool pool(options());
+
+  std::vector<Response::Status> statuses;
+  auto callback = [&statuses](Response &&response) { statuses.push_back(response.status); };
+  RequestHandle handle;
+  pool.enqueueRequest(models.request(model, {8}, callback, ResponseOptions(), handle));
+
+  Batch batch;
+  REQUIRE(pool.generateBatch(batch) == 1);
+  TestModels::drop(batch);
+  REQUIRE(statuses.size() == 1);
+
+  handle.cancel();
+  pool.dropCancelled();
+  RequestSentences cancelled;
+  pool.takeCancelled(cancelled);
+  CHECK(cancelled.empty());
+  CHECK(statuses.size() == 1);
+}
+
+TEST_CASE("Test BatchingPool lets go of a request once its sentences leave the pool") {
+  // A pending sentence holds its Request, which holds the model owning the pool: any left behind would keep both alive.
+  for (size_t maxPassedOver : {0, 2}) {
+    INFO("max-batches-passed-over: " << maxPassedOver);
+    TestModels models;
+    std::shared_ptr<TranslationModel> model =
+        models.model(kMiniBatchWords, "max-batches-passed-over: " + std::to_string(maxPassedOver) + "\n");
+    std::weak_ptr<TranslationModel> weakModel = model;
+
+    std::shared_ptr<Request> request = models.request(model, {8, 8}, [](Response &&) {});
+    std::weak_ptr<Request> weakRequest = request;
+    model->enqueueRequest(request);
+    request = nullptr;
+
+    Batch batch;
+    REQUIRE(model->generateBatch(batch) == 2);
+    TestModels::drop(batch);
+    batch.clear();
+    CHECK(weakRequest.expired());
+
+    model = nullptr;
+    CHECK(weakModel.expired());
+  }
+}
+
+TEST_CASE("Test ThreadsafeBatchingPool does not count a cancelled request towards accumulation") {
+  TestModels models;
+  auto model = models.model(kMiniBatchWords);
+  ThreadsafeBatchingPool<AggregateBatchingPool> pool;
+  pool.setAccumulation(/*fillWords=*/kMiniBatchWords, /*maxWait=*/std::chrono::hours(1));
+
+  std::vector<Response::Status> statuses;
+  auto callback = [&statuses](Response &&response) { statuses.push_back(response.status); };
+  RequestHandle handle;
+  pool.enqueueRequest(model, models.request(model, {8}, callback));
+  pool.enqueueRequest(model, models.request(model, {8}, callback, ResponseOptions(), handle));
+
+  // The cancelled request is completed as soon as the pool is looked at, ahead of the request pending with it.
+  handle.cancel();
+  CHECK(pool.pendingStats().sentences == 1);
+  CHECK(statuses == std::vector<Response::Status>{Response::CANCELLED});
+
+  // What is left does not fill a batch, until another request comes in.
+  std::shared_ptr<TranslationModel> batchModel;
+  Batch batch;
+  auto consumer = std::async(std::launch::async, [&]() { return pool.generateBatch(batchModel, batch); });
+  CHECK(consumer.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout);
+
+  pool.enqueueRequest(model, models.request(model, {8}, callback));
+  if (consumer.wait_for(std::chrono::seconds(10)) != std::future_status::ready) {
+    pool.shutdown();
+  }
+  CHECK(consumer.get() == 2);
+  pool.releaseBatch(batchModel);
+  TestModels::drop(batch);
+}
+
+TEST_CASE("Test ThreadsafeBatchingPool waits for accumulation from the arrival of the oldest pending request") {
+  using Clock = std::chrono::steady_clock;
+  const auto maxWait = std::chrono::milliseconds(500);
+  TestModels models;
+  auto model = models.model(kMiniBatchWords);
+  ThreadsafeBatchingPool<AggregateBatchingPool> pool;
+  pool.setAccumulation(/*fillWords=*/3 * kMiniBatchWords, maxWait);
+
+  // Each request fills a batch on its own, and the two together do not fill the words to accumulate.
+  auto ignore = [](Response &&) {};
+  Clock::time_point first = Clock::now();
+  pool.enqueueRequest(model, models.request(model, {16}, ignore));
+  std::this_thread::sleep_for(maxWait / 2);
+  Clock::time_point second = Clock::now();
+  pool.enqueueRequest(model, models.request(model, {16}, ignore));
+
+  // Both requests are taken up by the consumer only now, while the first has been waiting since it was enqueued.
+  std::shared_ptr<TranslationModel> batchModel;
+  Batch batch;
+  REQUIRE(pool.generateBatch(batchModel, batch) == 1);
+  CHECK(Clock::now() >= first + maxWait);
+  CHECK(Clock::now() < second + maxWait);
+  pool.releaseBatch(batchModel);
+  TestModels::drop(batch);
+  batch.clear();
+
+  // The second, left behind, gets to wait its own share.
+  REQUIRE(pool.generateBatch(batchModel, batch) == 1);
+  CHECK(Clock::now() >= second + maxWait);
+  pool.releaseBatch(batchModel);
+  TestModels::drop(batch);
+}
+
+TEST_CASE("Test ThreadsafeBatchingPool admits a request into room left by a cancelled one") {
+  TestModels models;
+  auto model = models.model(kMiniBatchWords);
+  AggregateBatchingPool::Config config;
+  config.maxPending.sentences = 2;
+  ThreadsafeBatchingPool<AggregateBatchingPool> pool(config);
+
+  std::vector<Response::Status> statuses;
+  auto callback = [&statuses](Response &&response) { statuses.push_back(response.status); };
+  RequestHandle handle;
+  REQUIRE(pool.tryEnqueueRequest(std::chrono::microseconds(0), model,
+                                 models.request(model, {8, 8}, callback, ResponseOptions(), handle)));
+
+  std::shared_ptr<Request> request = models.request(model, {8}, callback);
+  CHECK(!pool.tryEnqueueRequest(std::chrono::microseconds(0), model, request));
+
+  handle.cancel();
+  CHECK(pool.tryEnqueueRequest(std::chrono::microseconds(0), model, request));
+  CHECK(statuses == std::vector<Response::Status>{Response::CANCELLED});
+  CHECK(pool.pendingStats().sentences == 1);
+  pool.clear();
+}
+
+TEST_CASE("Test AggregateBatchingPool shares batches among models in proportion to their weights") {
+  TestModels models;
+  auto heavy = models.model(kMiniBatchWords, "scheduling-weight: 3\n");
+  auto light = models.model(kMiniBatchWords);
+  AggregateBatchingPool pool;
+
+  // A sentence of 16 words fills a batch, so that every batch costs the same.
+  auto ignore = [](Response &&) {};
+  for (size_t i = 0; i < 16; i++) {
+    pool.enqueueRequest(heavy, models.request(heavy, {16}, ignore));
+    pool.enqueueRequest(light, models.request(light, {16}, ignore));
+  }
+
+  // While both are busy, the heavier model gets three batches to every one of the lighter. Once the heavier runs out,
+  // the lighter gets every batch.
+  std::string order;
+  std::shared_ptr<TranslationModel> batchModel;
+  Batch batch;
+  while (pool.generateBatch(batchModel, batch) > 0) {
+    order += batchModel == heavy ? "h" : "l";
+    TestModels::drop(batch);
+    pool.releaseBatch(batchModel);
+    batch.clear();
+  }
+  CHECK(order == "hlhhhlhhhlhhhlhhhlhhhlllllllllll");
+}
+
+TEST_CASE("Test AggregateBatchingPool rejects requests beyond the limits on pending sentences") {
+  TestModels models;
+  auto first = models.model(kMiniBatchWords);
+  auto second = models.model(kMiniBatchWords);
+  AggregateBatchingPool::Config config;
+  config.maxPending.sentences = 3;
+  config.maxPendingPerModel.words = 16;
+  AggregateBatchingPool pool(config);
+
+  std::vector<Response::Status> statuses;
+  auto callback = [&statuses](Response &&response) { statuses.push_back(response.status); };
+
+  // An empty pool admits a request larger than the limits, else it would never be served.
+  std::shared_ptr<Request> large = models.request(first, {16, 8}, callback);
+  REQUIRE(pool.admits(first, large));
+  pool.enqueueRequest(first, large);
+
+  // The first model is over its words, the second has room, until the pool is over its sentences.
+  std::shared_ptr<Request> small = models.request(first, {4}, callback);
+  CHECK(!pool.admits(first, small));
+  CHECK(pool.admits(second, small));
+  pool.enqueueRequest(second, models.request(second, {4}, callback));
+  CHECK(!pool.admits(second, small));
+
+  // A request rejected is completed without translation.
+  small->abandon(Response::REJECTED);
+  CHECK(statuses == std::vector<Response::Status>{Response::REJECTED});
+  pool.clear();
+}
+
+TEST_CASE("Test BatchingPool times out a request past its deadline") {
+  TestModels models;
+  auto model = models.model(kMiniBatchWords);
+  BatchingPool pool(options());
+
+  std::vector<Response::Status> statuses;
+  auto callback = [&statuses](Response &&response) { statuses.push_back(response.status); };
+  ResponseOptions due;
+  due.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+  pool.enqueueRequest(models.request(model, {8, 8, 8}, callback, due));
+  pool.enqueueRequest(models.request(model, {4}, [](Response &&) {}));
+
+  // Within the deadline, sentences are batched as any other, and those due go first. Once past it, those left are
+  // dropped instead.
+  Batch batch;
+  REQUIRE(pool.generateBatch(batch) == 2);
+  CHECK(lengths(batch) == std::vector<size_t>{8, 8});
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  Batch late;
+  REQUIRE(pool.generateBatch(late) == 1);
+  CHECK(lengths(late) == std::vector<size_t>{4});
+
+  RequestSentences expired;
+  pool.takeCancelled(expired);
+  REQUIRE(expired.size() == 1);
+  complete(expired);
+  CHECK(statuses.empty());
+
+  // The Response is issued once the sentences in translation complete.
+  TestModels::drop(batch);
+  CHECK(statuses == std::vector<Response::Status>{Response::TIMED_OUT});
+  TestModels::drop(late);
+}
@@ -0,0 +1,77 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+#include "translator/bounded_queue.h"
+
+using namespace marian::bergamot;
+
+TEST_CASE("Test BoundedQueue bounds") {
+  BoundedQueue<int> queue(/*capacity=*/4);
+
+  int item = 0;
+  REQUIRE(!queue.tryPop(item));
+
+  for (int i = 0; i < 4; i++) {
+    int value = i;
+    REQUIRE(queue.tryPush(std::move(value)));
+  }
+
+  int overflow = 4;
+  REQUIRE(!queue.tryPush(std::move(overflow)));
+
+  // First in, first out.
+  for (int i = 0; i < 4; i++) {
+    REQUIRE(queue.tryPop(item));
+    REQUIRE(item == i);
+  }
+  REQUIRE(!queue.tryPop(item));
+}
+
+TEST_CASE("Test BoundedQueue in a threaded setting") {
+  size_t numProducers = 8;
+  size_t numConsumers = 8;
+  size_t itemsPerProducer = 10000;
+
+  BoundedQueue<size_t> queue(/*capacity=*/64);
+
+  std::atomic<size_t> consumed{0};
+  std::vector<std::atomic<size_t>> seen(numProducers * itemsPerProducer);
+  size_t total = seen.size();
+
+  std::vector<std::thread> threads;
+  for (size_t p = 0; p < numProducers; p++) {
+    threads.emplace_back([p, itemsPerProducer, &queue]() {
+      for (size_t i = 0; i < itemsPerProducer; i++) {
+        size_t item = p * itemsPerProducer + i;
+        while (!queue.tryPush(std::move(item))) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  for (size_t c = 0; c < numConsumers; c++) {
+    threads.emplace_back([total, &queue, &consumed, &seen]() {
+      size_t item;
+      while (consumed.load() < total) {
+        if (queue.tryPop(item)) {
+          seen[item].fetch_add(1);
+          consumed.fetch_add(1);
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // Every item is delivered exactly once.
+  for (auto &count : seen) {
+    REQUIRE(count.load() == 1);
+  }
+}
@@ -0,0 +1,74 @@
+#include <chrono>
+#include <cmath>
+#include <functional>
+
+#include "catch.hpp"
+#include "translator/mini_batch_words_tuner.h"
+
+using namespace marian::bergamot;
+
+namespace {
+
+// Feeds tuner full batches translated at the throughput (words per second) curve gives for the budget, until it
+// converges. Checks that the budget stays within bounds throughout. Returns the number of batches it took.
+size_t tune(MiniBatchWordsTuner &tuner, size_t minWords, size_t maxWords, const std::function<double(double)> &curve) {
+  size_t batches = 0;
+  while (!tuner.converged() && batches < 10000) {
+    size_t words = tuner.value();
+    REQUIRE(words >= minWords);
+    REQUIRE(words <= maxWords);
+    tuner.observe(words, words, std::chrono::duration<double>(words / curve(words)));
+    batches++;
+  }
+  return batches;
+}
+
+}  // namespace
+
+TEST_CASE("Test MiniBatchWordsTuner converges to the peak of throughput") {
+  // Throughput peaks at 1000 words, falling off on either side.
+  auto curve = [](double words) {
+    double distance = std::log(words / 1000);
+    return 1000 / (1 + distance * distance);
+  };
+
+  for (size_t initialWords : {64, 1000, 4096}) {
+    MiniBatchWordsTuner tuner(initialWords, /*minWords=*/16, /*maxWords=*/8192, /*enabled=*/true);
+    tune(tuner, 16, 8192, curve);
+    CHECK(tuner.converged());
+    CHECK(tuner.value() > 1000 / 1.2);
+    CHECK(tuner.value() < 1000 * 1.2);
+  }
+}
+
+TEST_CASE("Test MiniBatchWordsTuner keeps to its bounds") {
+  MiniBatchWordsTuner tuner(/*initialWords=*/1024, /*minWords=*/256, /*maxWords=*/2048, /*enabled=*/true);
+
+  SECTION("Throughput rising with the budget settles on the maximum") {
+    tune(tuner, 256, 2048, [](double words) { return words; });
+    CHECK(tuner.converged());
+    CHECK(tuner.value() == 2048);
+  }
+
+  SECTION("Throughput falling with the budget settles on the minimum") {
+    tune(tuner, 256, 2048, [](double words) { return 1 / words; });
+    CHECK(tuner.converged());
+    CHECK(tuner.value() == 256);
+  }
+}
+
+TEST_CASE("Test MiniBatchWordsTuner measures only batches full enough for the budget to matter") {
+  MiniBatchWordsTuner tuner(/*initialWords=*/1024, /*minWords=*/16, /*maxWords=*/8192, /*enabled=*/true);
+  for (size_t i = 0; i < 1000; i++) {
+    tuner.observe(/*words=*/100, /*paddedWords=*/128, std::chrono::duration<double>(0.001));
+  }
+  CHECK(!tuner.converged());
+  CHECK(tuner.value() == 1024);
+}
+
+TEST_CASE("Test MiniBatchWordsTuner stays at the initial budget when disabled") {
+  MiniBatchWordsTuner tuner(/*initialWords=*/1024, /*minWords=*/16, /*maxWords=*/8192, /*enabled=*/false);
+  CHECK(tuner.converged());
+  CHECK(!tuner.observe(1024, 1024, std::chrono::duration<double>(0.001)));
+  CHECK(tuner.value() == 1024);
+}
@@ -0,0 +1,102 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include "catch.hpp"
+#include "translator/model_package.h"
+
+using namespace marian::bergamot;
+
+namespace {
+
+AlignedMemory toMemory(const std::string &bytes, size_t alignment) {
+  AlignedMemory memory(bytes.size(), alignment);
+  std::memcpy(memory.begin(), bytes.data(), bytes.size());
+  return memory;
+}
+
+std::string toString(const AlignedMemory &memory) { return std::string(memory.begin(), memory.size()); }
+
+class MarianThrowsExceptionsFixture {
+ protected:
+  MarianThrowsExceptionsFixture() : prev_(marian::getThrowExceptionOnAbort()) {
+    marian::setThrowExceptionOnAbort(true);
+  }
+  ~MarianThrowsExceptionsFixture() { marian::setThrowExceptionOnAbort(prev_); }
+
+ private:
+  bool prev_;
+};
+
+}  // namespace
+
+TEST_CASE_METHOD(MarianThrowsExceptionsFixture, "Test round trip of model package") {
+  // Smallest valid binary model: version 1, no items, no padding.
+  std::string model(3 * sizeof(uint64_t), '\0');
+  uint64_t version = 1;
+  std::memcpy(&model[0], &version, sizeof(uint64_t));
+
+  MemoryBundle memory;
+  memory.model = toMemory(model, 256);
+  memory.shortlist = toMemory("shortlist", 64);
+  auto vocab = std::make_shared<AlignedMemory>(toMemory(std::string(100000, 'v'), 64));
+  memory.vocabs = {vocab, vocab};
+  memory.qualityEstimatorMemory = toMemory("quality", 64);
+
+  const std::string path = "model_package_tests.bergamot";
+  writeModelPackage(path, "models: [model.bin]\n", memory);
+  REQUIRE(validateModelPackage(path));
+
+  std::string config;
+  MemoryBundle loaded = loadModelPackage(path, config);
+  CHECK(config == "models: [model.bin]\n");
+  CHECK(toString(loaded.model) == model);
+  CHECK(reinterpret_cast<uintptr_t>(loaded.model.begin()) % 256 == 0);
+  CHECK(toString(loaded.shortlist) == "shortlist");
+  REQUIRE(loaded.vocabs.size() == 2);
+  CHECK(loaded.vocabs[0] == loaded.vocabs[1]);
+  CHECK(toString(*loaded.vocabs[0]) == toString(*vocab));
+  CHECK(loaded.ssplitPrefixFile.size() == 0);
+  CHECK(toString(loaded.qualityEstimatorMemory) == "quality");
+
+  SECTION("Corruption is detected") {
+    {
+      // Sections are stored in order config, model, shortlist, vocab.
+      std::fstream package(path, std::ios::in | std::ios::out | std::ios::binary);
+      package.seekp(static_cast<std::streamoff>(4 * kModelPackageAlignment + 10));
+      package.put('x');
+    }
+    CHECK(!validateModelPackage(path));
+    CHECK_NOTHROW(loadModelPackage(path, config));
+    CHECK_THROWS(loadModelPackage(path, config, /*validate=*/true));
+  }
+
+  SECTION("Truncation is detected") {
+    std::string bytes;
+    {
+      std::ifstream package(path, std::ios::binary);
+      bytes.assign(std::istreambuf_iterator<char>(package), std::istreambuf_iterator<char>());
+    }
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size() - 1);
+    CHECK(!validateModelPackage(path));
+    CHECK_THROWS(loadModelPackage(path, config));
+  }
+
+  SECTION("Vocabs out of position are detected") {
+    {
+      // Entries follow a header of 3 and are of 5 integers each, the second of which is the position of a vocab. The
+      // second vocab is the fifth entry.
+      std::fstream package(path, std::ios::in | std::ios::out | std::ios::binary);
+      uint64_t position = 2;
+      package.seekp(static_cast<std::streamoff>((3 + 4 * 5 + 1) * sizeof(uint64_t)));
+      package.write(reinterpret_cast<const char *>(&position), sizeof(uint64_t));
+    }
+    CHECK(!validateModelPackage(path));
+    CHECK_THROWS(loadModelPackage(path, config));
+  }
+
+  std::remove(path.c_str());
+}
@@ -0,0 +1,160 @@
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+#include "test_models.h"
+#include "translator/model_registry.h"
+
+using namespace marian::bergamot;
+
+namespace {
+
+constexpr size_t kMB = 1024 * 1024;
+
+// Registers models by name, each holding a MB.
+void addModels(ModelRegistry &registry, const std::vector<std::string> &names) {
+  for (const std::string &name : names) {
+    registry.add(
+        name, []() { return TestModels::load(TestModels::config(), kMB); }, /*estimatedBytes=*/kMB);
+  }
+}
+
+ModelRegistry::Config budget(size_t memoryBudgetInMB, size_t drainTimeoutInMilliseconds) {
+  ModelRegistry::Config config;
+  config.memoryBudgetInMB = memoryBudgetInMB;
+  config.drainTimeoutInMilliseconds = drainTimeoutInMilliseconds;
+  return config;
+}
+
+}  // namespace
+
+TEST_CASE("Test ModelRegistry unloads the least recently used model") {
+  TestModels models;
+  ModelRegistry registry(budget(/*memoryBudgetInMB=*/3, /*drainTimeoutInMilliseconds=*/1000));
+  addModels(registry, {"a", "b", "c", "d"});
+
+  registry.get("a");
+  registry.get("b");
+  registry.get("c");
+  registry.get("a");
+  REQUIRE(registry.residentBytes() == 3 * kMB);
+
+  registry.get("d");
+  CHECK(registry.loaded("a"));
+  CHECK(!registry.loaded("b"));
+  CHECK(registry.loaded("c"));
+  CHECK(registry.loaded("d"));
+  CHECK(registry.residentBytes() == 3 * kMB);
+}
+
+TEST_CASE("Test ModelRegistry makes room ahead of loading a model the first time") {
+  TestModels models;
+  ModelRegistry registry(budget(/*memoryBudgetInMB=*/2, /*drainTimeoutInMilliseconds=*/1000));
+  addModels(registry, {"a", "b"});
+  registry.get("a");
+  registry.get("b");
+
+  // While c loads, the room estimated for it is taken already.
+  bool checked = false;
+  registry.add(
+      "c",
+      [&registry, &checked]() {
+        CHECK(!registry.loaded("a"));
+        CHECK(registry.loaded("b"));
+        CHECK(registry.residentBytes() == 2 * kMB);
+        checked = true;
+        return TestModels::load(TestModels::config(), kMB);
+      },
+      /*estimatedBytes=*/kMB);
+
+  registry.get("c");
+  CHECK(checked);
+  CHECK(registry.residentBytes() == 2 * kMB);
+}
+
+TEST_CASE("Test ModelRegistry waits for a model in use to be freed") {
+  TestModels models;
+  ModelRegistry registry(budget(/*memoryBudgetInMB=*/1, /*drainTimeoutInMilliseconds=*/10000));
+  addModels(registry, {"a", "b"});
+
+  std::shared_ptr<TranslationModel> inUse = registry.get("a");
+  std::atomic<bool> released{false};
+  std::thread user([&inUse, &released]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    released = true;
+    inUse = nullptr;
+  });
+
+  registry.get("b");
+  CHECK(released);
+  CHECK(!registry.loaded("a"));
+  CHECK(registry.residentBytes() == kMB);
+  user.join();
+}
+
+TEST_CASE("Test ModelRegistry reloads a model while the copy unloaded is in use") {
+  TestModels models;
+  ModelRegistry registry(budget(/*memoryBudgetInMB=*/2, /*drainTimeoutInMilliseconds=*/50));
+  addModels(registry, {"a", "b", "c"});
+
+  // The copy of a unloaded while in use still counts against the budget, so that b is unloaded too to make room for c.
+  std::shared_ptr<TranslationModel> unloaded = registry.get("a");
+  registry.get("b");
+  registry.get("c");
+  REQUIRE(!registry.loaded("a"));
+  REQUIRE(!registry.loaded("b"));
+  REQUIRE(registry.residentBytes() == 2 * kMB);
+
+  std::shared_ptr<TranslationModel> reloaded = registry.get("a");
+  CHECK(reloaded != unloaded);
+  CHECK(registry.loaded("a"));
+  CHECK(!registry.loaded("c"));
+  CHECK(registry.residentBytes() == 2 * kMB);
+
+  unloaded = nullptr;
+  CHECK(registry.residentBytes() == kMB);
+}
+
+TEST_CASE("Test ModelRegistry keeps a model unloaded until its responses are built") {
+  TestModels models;
+  ModelRegistry registry(budget(/*memoryBudgetInMB=*/1, /*drainTimeoutInMilliseconds=*/50));
+  addModels(registry, {"a", "b"});
+
+  // Responses are built on a completer the test runs by hand, after the model is unloaded.
+  std::vector<std::function<void()>> completions;
+  Executor completer = [&completions](std::function<void()> task) { completions.push_back(std::move(task)); };
+
+  std::shared_ptr<TranslationModel> model = registry.get("a");
+  std::weak_ptr<TranslationModel> weakModel = model;
+  RequestHandle handle;
+  Response::Status status = Response::SUCCESS;
+  auto callback = [&status](Response &&response) { status = response.status; };
+  model->enqueueRequest(models.request(model, {4, 4}, callback, ResponseOptions(), handle, completer));
+
+  Batch batch;
+  REQUIRE(model->generateBatch(batch) == 2);
+  model = nullptr;
+
+  // Cancelled while in translation: the batch completes, with the Response left to build.
+  handle.cancel();
+  TestModels::drop(batch);
+  batch.clear();
+  REQUIRE(completions.size() == 1);
+
+  registry.get("b");
+  CHECK(!registry.loaded("a"));
+  CHECK(!weakModel.expired());
+  CHECK(registry.residentBytes() == 2 * kMB);
+
+  for (std::function<void()> &completion : completions) {
+    completion();
+  }
+  completions.clear();
+  CHECK(status == Response::CANCELLED);
+  CHECK(weakModel.expired());
+  CHECK(registry.residentBytes() == kMB);
+}
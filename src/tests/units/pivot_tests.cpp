@@ -0,0 +1,167 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+#include "translator/pivot.h"
+
+using namespace marian::bergamot;
+
+namespace {
+
+// Text of sentences, each given by its gap before and its words, and then the ending whitespace.
+AnnotatedText annotate(const std::vector<std::pair<std::string, std::vector<std::string>>> &sentences,
+                       const std::string &ending) {
+  AnnotatedText text;
+  for (auto &[gap, words] : sentences) {
+    // Words are to be contiguous.
+    std::string joined;
+    for (const std::string &word : words) {
+      joined += word;
+    }
+    std::vector<marian::string_view> views;
+    size_t offset = 0;
+    for (const std::string &word : words) {
+      views.emplace_back(joined.data() + offset, word.size());
+      offset += word.size();
+    }
+    text.appendSentence(gap, views.begin(), views.end());
+  }
+  text.appendEndingWhitespace(ending);
+  return text;
+}
+
+Response translated(AnnotatedText &&source, AnnotatedText &&target, std::vector<Alignment> &&alignments) {
+  Response response;
+  response.source = std::move(source);
+  response.target = std::move(target);
+  response.alignments = std::move(alignments);
+  return response;
+}
+
+// Source to pivot, with each pivot word aligned to the source word at the same position.
+Response sourceToPivot() {
+  return translated(annotate({{"", {"S1", " S2", "."}}, {" ", {"S3", "!"}}}, "\n"),
+                    annotate({{"", {"P1", " P2", "."}}, {" ", {"P3", "!"}}}, "\n"),
+                    {{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}, {{1, 0}, {0, 1}}});
+}
+
+// The first sentence of the pivot to target, with the words swapped.
+Response firstSentence() {
+  return translated(annotate({{"", {"P1", " P2", "."}}}, ""), annotate({{"", {"T2", " T1", "."}}}, ""),
+                    {{{0, 1, 0}, {1, 0, 0}, {0, 0, 1}}});
+}
+
+Response secondSentence() {
+  return translated(annotate({{"", {"P3", "!"}}}, ""), annotate({{"", {"T3", "!"}}}, ""), {{{1, 0}, {0, 1}}});
+}
+
+}  // namespace
+
+TEST_CASE("Test PivotJoin stitches sentences translated in the second leg") {
+  std::string html = "S1 S2. S3!\n";
+  bool done = false;
+  std::vector<Response> responses;
+  auto callback = [&responses](Response &&response) { responses.push_back(std::move(response)); };
+  auto join = std::make_shared<PivotJoin>(callback, std::make_shared<HTML>(std::move(html), /*processMarkup=*/false),
+                                          [&done]() { done = true; });
+
+  // Sentences come in as they are translated, in any order and before or after the first leg completes.
+  join->issue();
+  join->issue();
+  join->completeSentence(1, secondSentence());
+  join->completeFirst(sourceToPivot());
+  CHECK(responses.empty());
+  join->completeSentence(0, firstSentence());
+  REQUIRE(responses.size() == 1);
+
+  Response &response = responses.front();
+  CHECK(response.status == Response::SUCCESS);
+  CHECK(response.source.text == "S1 S2. S3!\n");
+  CHECK(response.target.text == "T2 T1. T3!\n");
+  REQUIRE(response.target.numSentences() == 2);
+  CHECK(response.target.sentence(0) == "T2 T1.");
+  CHECK(response.target.gap(1) == " ");
+  CHECK(response.target.sentence(1) == "T3!");
+  CHECK(response.target.word(1, 0) == "T3");
+
+  // Alignments to the source go through the pivot: the target words are swapped with respect to the pivot, the pivot
+  // words are in the order of the source.
+  REQUIRE(response.alignments.size() == 2);
+  CHECK(response.alignments[0] == Alignment{{0, 1, 0}, {1, 0, 0}, {0, 0, 1}});
+  CHECK(response.alignments[1] == Alignment{{1, 0}, {0, 1}});
+
+  CHECK(!done);
+  join = nullptr;
+  CHECK(done);
+}
+
+TEST_CASE("Test PivotJoin reports an incomplete second leg") {
+  std::string html = "S1 S2. S3!\n";
+  std::vector<Response> responses;
+  PivotJoin join([&responses](Response &&response) { responses.push_back(std::move(response)); },
+                 std::make_shared<HTML>(std::move(html), /*processMarkup=*/false));
+
+  Response cancelled = secondSentence();
+  cancelled.status = Response::CANCELLED;
+  join.issue();
+  join.issue();
+  join.completeSentence(0, firstSentence());
+  join.completeSentence(1, std::move(cancelled));
+  join.completeFirst(sourceToPivot());
+
+  REQUIRE(responses.size() == 1);
+  CHECK(responses.front().status == Response::CANCELLED);
+  CHECK(responses.front().source.text == "S1 S2. S3!\n");
+  CHECK(responses.front().alignments.empty());
+}
+
+TEST_CASE("Test PivotJoin keeps a sentence for each in source of an incomplete first leg") {
+  std::string html = "S1 S2. S3!\n";
+  std::vector<Response> responses;
+  PivotJoin join([&responses](Response &&response) { responses.push_back(std::move(response)); },
+                 std::make_shared<HTML>(std::move(html), /*processMarkup=*/false));
+
+  // Cancelled once the first sentence is through the first leg: the second never makes it to the second leg.
+  Response cancelled = sourceToPivot();
+  cancelled.status = Response::CANCELLED;
+  join.issue();
+  join.completeSentence(0, firstSentence());
+  join.completeFirst(std::move(cancelled));
+
+  REQUIRE(responses.size() == 1);
+  const Response &response = responses.front();
+  CHECK(response.status == Response::CANCELLED);
+  CHECK(response.source.text == "S1 S2. S3!\n");
+  REQUIRE(response.target.numSentences() == response.source.numSentences());
+  CHECK(response.target.text == "T2 T1. \n");
+  CHECK(response.target.sentence(0) == "T2 T1.");
+  CHECK(response.target.sentence(1).empty());
+  CHECK(response.alignments.empty());
+}
+
+TEST_CASE("Test PivotJoin keeps a sentence for each in source of a pivot past its deadline") {
+  std::string html = "S1 S2. S3!\n";
+  std::vector<Response> responses;
+  PivotJoin join([&responses](Response &&response) { responses.push_back(std::move(response)); },
+                 std::make_shared<HTML>(std::move(html), /*processMarkup=*/false));
+
+  // Past the deadline with the first sentence in the second leg, and the second still in the first: neither makes it
+  // through both legs.
+  Response timedOut = sourceToPivot();
+  timedOut.status = Response::TIMED_OUT;
+  Response sentenceTimedOut = translated(annotate({{"", {"P1", " P2", "."}}}, ""), annotate({{"", {}}}, ""), {});
+  sentenceTimedOut.status = Response::TIMED_OUT;
+  join.issue();
+  join.completeFirst(std::move(timedOut));
+  CHECK(responses.empty());
+  join.completeSentence(0, std::move(sentenceTimedOut));
+
+  REQUIRE(responses.size() == 1);
+  const Response &response = responses.front();
+  CHECK(response.status == Response::TIMED_OUT);
+  REQUIRE(response.target.numSentences() == response.source.numSentences());
+  CHECK(response.target.text == " \n");
+  CHECK(response.target.sentence(0).empty());
+  CHECK(response.target.sentence(1).empty());
+}
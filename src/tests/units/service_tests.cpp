@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "catch.hpp"
+#include "test_models.h"
+#include "translator/service.h"
+
+using namespace marian::bergamot;
+
+TEST_CASE("Test AsyncService clamps the number of workers to its capacity") {
+  AsyncService::Config config;
+  config.numWorkers = 1;
+  config.workspaceSizeInMB = 1;
+  AsyncService service(config);
+
+  size_t capacity = std::max<size_t>(config.numWorkers, std::thread::hardware_concurrency());
+  CHECK(service.setNumWorkers(capacity + 1) == capacity);
+  CHECK(service.numWorkers() == capacity);
+
+  CHECK(service.setNumWorkers(1) == 1);
+  CHECK(service.numWorkers() == 1);
+}
+
+#ifdef BERGAMOT_COROUTINES
+namespace {
+
+// Coroutine which runs as soon as called, its frame freed as soon as it is done.
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+Detached awaitTranslation(AsyncService &service, std::shared_ptr<TranslationModel> model, std::string source,
+                          std::optional<Response> &response) {
+  response = co_await service.translateAwaitable(std::move(model), std::move(source));
+}
+
+}  // namespace
+
+TEST_CASE("Test AsyncService resumes a coroutine awaiting a translation complete on request") {
+  TestModels models;
+  AsyncService::Config config;
+  config.numWorkers = 1;
+  config.workspaceSizeInMB = 1;
+  AsyncService service(config);
+
+  // Nothing to translate, as when all is found in cache: the coroutine is resumed, and its frame freed, from within
+  // translation, which must not touch the awaitable after.
+  std::optional<Response> response;
+  awaitTranslation(service, models.model(), "", response);
+  REQUIRE(response);
+  CHECK(response->status == Response::SUCCESS);
+  CHECK(response->source.numSentences() == 0);
+}
+#endif
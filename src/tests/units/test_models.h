@@ -0,0 +1,100 @@
+#pragma once
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "translator/batch.h"
+#include "translator/cache.h"
+#include "translator/definitions.h"
+#include "translator/parser.h"
+#include "translator/quality_estimator.h"
+#include "translator/request.h"
+#include "translator/response_builder.h"
+#include "translator/translation_model.h"
+#include "translator/vocabs.h"
+
+namespace marian {
+namespace bergamot {
+
+/// TranslationModels and Requests for tests of scheduling and lifetimes, which need sentences to batch but nothing
+/// translated. Models have a vocabulary of a few words and parameters that mean nothing, and are never to translate:
+/// batches generated from them are completed with drop(...) instead, as sentences of cancelled requests are.
+///
+/// Requests refer to the vocabularies and quality estimator held here, so these outlive them.
+class TestModels {
+ public:
+  TestModels()
+      : vocabs_(writeVocab(), std::vector<std::shared_ptr<AlignedMemory>>()),
+        qualityEstimator_(createQualityEstimator(AlignedMemory())) {}
+
+  /// Configuration (YAML) of a model, with sentences of up to 16 tokens in batches of miniBatchWords, and any other
+  /// options in extra.
+  static std::string config(size_t miniBatchWords = 32, const std::string &extra = "") {
+    return "vocabs: [test-vocab.yml, test-vocab.yml]\n"
+           "max-length-break: 8\n"
+           "max-length-factor: 2\n"
+           "mini-batch-words: " +
+           std::to_string(miniBatchWords) + "\n" + extra;
+  }
+
+  /// A model as configured, holding parameterBytes in memory, which is all it reports as resident.
+  static std::unique_ptr<TranslationModel> load(const std::string &config, size_t parameterBytes = 256) {
+    MemoryBundle memory;
+    memory.model = AlignedMemory(parameterBytes, 256);
+    return std::make_unique<TranslationModel>(config, std::move(memory));
+  }
+
+  std::shared_ptr<TranslationModel> model(size_t miniBatchWords = 32, const std::string &extra = "") {
+    return load(config(miniBatchWords, extra));
+  }
+
+  /// A Request to model, of sentences of the given lengths in tokens. Requests are numbered in order of creation.
+  Ptr<Request> request(const std::shared_ptr<TranslationModel> &model, const std::vector<size_t> &lengths,
+                       CallbackType callback, const ResponseOptions &responseOptions = ResponseOptions(),
+                       const RequestHandle &handle = RequestHandle(), const Executor &completer = nullptr) {
+    AnnotatedText source;
+    Segments segments;
+    for (size_t length : lengths) {
+      // Words of a sentence are to be contiguous.
+      std::string sentence;
+      for (size_t i = 0; i < length; i++) {
+        sentence += " word";
+      }
+      std::vector<string_view> words;
+      for (size_t i = 0; i < length; i++) {
+        words.emplace_back(sentence.data() + 5 * i, 5);
+      }
+      source.appendSentence("", words.begin(), words.end());
+      segments.emplace_back(length, Word::fromWordIndex(2));
+    }
+    source.appendEndingWhitespace("");
+
+    ResponseBuilder responseBuilder(responseOptions, std::move(source), vocabs_, callback, *qualityEstimator_);
+    Ptr<Request> request = New<Request>(requestId_++, model, std::move(segments), std::move(responseBuilder),
+                                        responseOptions, cache_, handle, completer);
+    request->completePrefilled();
+    return request;
+  }
+
+  /// Completes the sentences in batch without translating them. The Response to a Request none of whose sentences are
+  /// translated is marked CANCELLED if the Request was cancelled, TIMED_OUT otherwise.
+  static void drop(Batch &batch) { batch.completeBatch(Histories(batch.size(), nullptr)); }
+
+ private:
+  static Ptr<Options> writeVocab() {
+    std::ofstream out("test-vocab.yml");
+    out << "</s>: 0\n<unk>: 1\nword: 2\n";
+    out.close();
+    return parseOptionsFromString(config(), /*validate=*/false);
+  }
+
+  Vocabs vocabs_;
+  std::shared_ptr<QualityEstimator> qualityEstimator_;
+  std::optional<TranslationCache> cache_;
+  size_t requestId_{0};
+};
+
+}  // namespace bergamot
+}  // namespace marian
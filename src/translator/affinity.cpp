@@ -0,0 +1,70 @@
+#include "affinity.h"
+
+#include <fstream>
+#include <sstream>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace marian {
+namespace bergamot {
+
+bool pinCurrentThread(const std::vector<size_t> &cpus) {
+#if defined(__linux__)
+  if (cpus.empty()) {
+    return false;
+  }
+
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  for (size_t cpu : cpus) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &cpuSet);
+    }
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+
+std::vector<std::vector<size_t>> numaNodeCpus() {
+  std::vector<std::vector<size_t>> nodes;
+#if defined(__linux__)
+  // Nodes are numbered contiguously from 0.
+  for (size_t node = 0;; node++) {
+    std::ifstream cpuListFile("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string cpuList;
+    if (!cpuListFile || !std::getline(cpuListFile, cpuList)) {
+      break;
+    }
+    nodes.push_back(parseCpuList(cpuList));
+  }
+#endif
+  return nodes;
+}
+
+std::vector<size_t> parseCpuList(const std::string &cpuList) {
+  std::vector<size_t> cpus;
+  std::stringstream stream(cpuList);
+  std::string range;
+  while (std::getline(stream, range, ',')) {
+    if (range.empty() || range.find_first_not_of(" \n") == std::string::npos) {
+      continue;
+    }
+
+    size_t dash = range.find('-');
+    size_t first = std::stoul(range.substr(0, dash));
+    size_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+    for (size_t cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+}  // namespace bergamot
+}  // namespace marian
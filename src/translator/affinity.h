@@ -0,0 +1,26 @@
+#ifndef SRC_BERGAMOT_AFFINITY_H_
+#define SRC_BERGAMOT_AFFINITY_H_
+
+#include <string>
+#include <vector>
+
+namespace marian {
+namespace bergamot {
+
+/// Restricts the calling thread to run on cpus, identified as by the operating system. Memory the thread touches first
+/// after is then (under the default first-touch policy) placed on the NUMA node of those cpus.
+///
+/// @returns false if cpus is empty, or pinning is not supported on the platform or fails.
+bool pinCurrentThread(const std::vector<size_t> &cpus);
+
+/// CPUs of each NUMA node on this machine, indexed by node. Empty if the topology is not available (non-Linux), in
+/// which case the machine is best treated as a single node.
+std::vector<std::vector<size_t>> numaNodeCpus();
+
+/// Parses a list of cpus in the format of Linux sysfs cpulist files, e.g. "0-3,8,10-11".
+std::vector<size_t> parseCpuList(const std::string &cpuList);
+
+}  // namespace bergamot
+}  // namespace marian
+
+#endif  // SRC_BERGAMOT_AFFINITY_H_
@@ -1,36 +1,213 @@
 
 #include "aggregate_batching_pool.h"
 
+#include <algorithm>
+#include <cassert>
+
 namespace marian {
 namespace bergamot {
 
-AggregateBatchingPool::AggregateBatchingPool() {
-  // TODO(@jerinphilip): Set aggregate limits
+namespace {
+
+/// Whether adding cost to pending stays within limit. An empty queue admits anything, else requests larger than a
+/// limit would never be served.
+bool withinLimit(const BatchingPool::Stats& pending, const BatchingPool::Stats& cost,
+                 const BatchingPool::Stats& limit) {
+  if (pending.sentences == 0) {
+    return true;
+  }
+
+  auto within = [](size_t pending, size_t cost, size_t limit) { return limit == 0 || pending + cost <= limit; };
+  return within(pending.sentences, cost.sentences, limit.sentences) && within(pending.words, cost.words, limit.words) &&
+         within(pending.bytes, cost.bytes, limit.bytes);
+}
+
+}  // namespace
+
+AggregateBatchingPool::AggregateBatchingPool(const Config& config) : config_(config) {}
+
+AggregateBatchingPool::AggregateBatchingPool() : AggregateBatchingPool(Config()) {}
+
+bool AggregateBatchingPool::admits(const Ptr<TranslationModel>& model, const Ptr<Request>& request) const {
+  BatchingPool::Stats cost = BatchingPool::toBeTranslated(*request);
+  if (cost.sentences == 0) {
+    // Served entirely from cache, nothing to hold in the queue.
+    return true;
+  }
+
+  return withinLimit(pendingStats(), cost, config_.maxPending) &&
+         withinLimit(pendingStats(model), cost, config_.maxPendingPerModel);
+}
+
+bool AggregateBatchingPool::admits(const Ptr<TranslationModel>& model,
+                                   const std::vector<Ptr<Request>>& requests) const {
+  BatchingPool::Stats cost;
+  for (const Ptr<Request>& request : requests) {
+    BatchingPool::Stats requestCost = BatchingPool::toBeTranslated(*request);
+    cost.sentences += requestCost.sentences;
+    cost.words += requestCost.words;
+    cost.bytes += requestCost.bytes;
+  }
+
+  if (cost.sentences == 0) {
+    return true;
+  }
+
+  return withinLimit(pendingStats(), cost, config_.maxPending) &&
+         withinLimit(pendingStats(model), cost, config_.maxPendingPerModel);
+}
+
+size_t AggregateBatchingPool::enqueueRequest(Ptr<TranslationModel> model, const std::vector<Ptr<Request>>& requests) {
+  size_t sentencesEnqueued = 0;
+  for (const Ptr<Request>& request : requests) {
+    sentencesEnqueued += enqueueRequest(model, request);
+  }
+  return sentencesEnqueued;
 }
 
 size_t AggregateBatchingPool::enqueueRequest(Ptr<TranslationModel> model, Ptr<Request> request) {
   size_t sentencesEnqueued = model->enqueueRequest(request);
-  aggregateQueue_.insert(model);
+  Share& share = shares_[model];
+  if (!share.pending) {
+    // A model turning busy is not owed for the time it was idle.
+    share.virtualTime = std::max(share.virtualTime, virtualClock_);
+    share.pending = true;
+  }
   return sentencesEnqueued;
 }
 
+bool AggregateBatchingPool::atLimit(const TranslationModel& model, const Share& share) const {
+  size_t modelLimit = model.maxActiveBatches();
+  size_t poolLimit = config_.maxActiveBatchesPerModel;
+  return (modelLimit > 0 && share.activeBatches >= modelLimit) || (poolLimit > 0 && share.activeBatches >= poolLimit);
+}
+
 size_t AggregateBatchingPool::generateBatch(Ptr<TranslationModel>& model, Batch& batch) {
-  while (!aggregateQueue_.empty()) {
-    auto candidateItr = aggregateQueue_.begin();
-    Ptr<TranslationModel> candidate = *candidateItr;
+  while (true) {
+    // Pick the pending model with the least virtual time among those allowed another active batch. Ties are broken on
+    // modelId, to not depend on the iteration order of shares_.
+    auto candidateItr = shares_.end();
+    for (auto itr = shares_.begin(); itr != shares_.end(); ++itr) {
+      const Ptr<TranslationModel>& candidate = itr->first;
+      const Share& share = itr->second;
+      if (!share.pending || atLimit(*candidate, share)) {
+        continue;
+      }
+
+      if (candidateItr == shares_.end() || share.virtualTime < candidateItr->second.virtualTime ||
+          (share.virtualTime == candidateItr->second.virtualTime &&
+           candidate->modelId() < candidateItr->first->modelId())) {
+        candidateItr = itr;
+      }
+    }
+
+    if (candidateItr == shares_.end()) {
+      return /*numSentences=*/0;
+    }
+
+    Ptr<TranslationModel> candidate = candidateItr->first;
+    Share& share = candidateItr->second;
     size_t numSentences = candidate->generateBatch(batch);
+    candidate->takeCancelled(cancelled_);
     if (numSentences > 0) {
+      size_t maxLength = 0;
+      for (auto& sentence : batch.sentences()) {
+        maxLength = std::max(maxLength, sentence.numTokens());
+      }
+
+      virtualClock_ = share.virtualTime;
+      share.virtualTime += static_cast<double>(numSentences * maxLength) / candidate->schedulingWeight();
+      share.activeBatches += 1;
       model = candidate;
       return numSentences;
     } else {
       // Try the next model's batching pool.
-      aggregateQueue_.erase(candidateItr);
+      share.pending = false;
+      if (share.activeBatches == 0) {
+        shares_.erase(candidateItr);
+      }
     }
   }
-  return /*numSentences=*/0;
 }
 
-void AggregateBatchingPool::clear() { aggregateQueue_.clear(); }
+void AggregateBatchingPool::dropCancelled() {
+  for (auto& [model, share] : shares_) {
+    if (share.pending) {
+      model->dropCancelled();
+      model->takeCancelled(cancelled_);
+    }
+  }
+}
+
+void AggregateBatchingPool::takeCancelled(RequestSentences& cancelled) {
+  cancelled.insert(cancelled.end(), cancelled_.begin(), cancelled_.end());
+  cancelled_.clear();
+}
+
+void AggregateBatchingPool::releaseBatch(const Ptr<TranslationModel>& model) {
+  auto itr = shares_.find(model);
+  assert(itr != shares_.end() && itr->second.activeBatches > 0);
+  Share& share = itr->second;
+  share.activeBatches -= 1;
+  if (share.activeBatches == 0 && !share.pending) {
+    shares_.erase(itr);
+  }
+}
+
+void AggregateBatchingPool::clear() {
+  for (auto itr = shares_.begin(); itr != shares_.end();) {
+    if (itr->second.pending) {
+      itr->first->clearPending();
+    }
+    itr->second.pending = false;
+    if (itr->second.activeBatches == 0) {
+      itr = shares_.erase(itr);
+    } else {
+      ++itr;
+    }
+  }
+}
+
+size_t AggregateBatchingPool::pendingWords() const {
+  size_t words = 0;
+  for (auto& [model, share] : shares_) {
+    if (share.pending) {
+      words += model->pendingWords();
+    }
+  }
+  return words;
+}
+
+std::chrono::steady_clock::time_point AggregateBatchingPool::oldestArrival() {
+  auto oldest = std::chrono::steady_clock::time_point::max();
+  for (auto& [model, share] : shares_) {
+    if (share.pending) {
+      oldest = std::min(oldest, model->oldestPendingArrival());
+    }
+  }
+  return oldest;
+}
+
+BatchingPool::Stats AggregateBatchingPool::pendingStats() const {
+  BatchingPool::Stats stats;
+  for (auto& [model, share] : shares_) {
+    if (share.pending) {
+      const BatchingPool::Stats& modelStats = model->pendingStats();
+      stats.sentences += modelStats.sentences;
+      stats.words += modelStats.words;
+      stats.bytes += modelStats.bytes;
+    }
+  }
+  return stats;
+}
+
+BatchingPool::Stats AggregateBatchingPool::pendingStats(const Ptr<TranslationModel>& model) const {
+  auto itr = shares_.find(model);
+  if (itr == shares_.end() || !itr->second.pending) {
+    return BatchingPool::Stats();
+  }
+  return model->pendingStats();
+}
 
 }  // namespace bergamot
 }  // namespace marian
@@ -1,8 +1,11 @@
 #ifndef SRC_BERGAMOT_AGGREGATE_BATCHING_POOL_H_
 #define SRC_BERGAMOT_AGGREGATE_BATCHING_POOL_H_
 
+#include <chrono>
 #include <memory>
 #include <queue>
+#include <unordered_map>
+#include <vector>
 
 #include "data/types.h"
 #include "translation_model.h"
@@ -25,10 +28,16 @@ struct HashPtr {
 /// specifically), thereby acting as an intermediary to enable multiple translation model capability in BlockingService
 /// and AsyncService.
 ///
-/// A simple queue containing shared owning references to TranslationModels are held here from which batches are
-/// generated on demand. Since a queue is involved, the ordering is first-come first serve on requests except there are
-/// leaks effectively doing priority inversion if an earlier request with the same TranslationModel is pending
-/// to be consumed for translation.
+/// TranslationModels with pending requests share the workers by weighted fair queueing. Each model accumulates a
+/// virtual time, advanced by the (padded) words in every batch generated from it scaled by the inverse of its
+/// `scheduling-weight`. The next batch is generated from the pending model with the least virtual time, so over a busy
+/// period models are served words in proportion to their weights, and no pending model waits on another for longer
+/// than it takes the other to consume its share. A model which turns busy after being idle starts at the current
+/// virtual time, rather than cashing in on credit from the idle period.
+///
+/// Additionally, a model can be capped in the number of its batches in translation at the same time, through its
+/// `max-active-batches` option or the pool-wide default in Config. This keeps a busy model from occupying every worker.
+/// Batches generated must be returned through `releaseBatch(...)` once translated, for this accounting.
 //
 /// Actual storage for the request and batch generation are within the respective TranslationModels, which owns its own
 /// BatchingPool.
@@ -39,10 +48,60 @@ struct HashPtr {
 /// equivalent of this class, if needed.
 class AggregateBatchingPool {
  public:
-  /// Create an AggregateBatchingPool with (tentatively) global (across all BatchingPools) limits
-  /// imposed here.
+  struct Config {
+    /// Limit on batches of a single model in translation at the same time, applied in addition to a model's own
+    /// `max-active-batches`. A value of 0 means no limit.
+    size_t maxActiveBatchesPerModel{0};
+
+    /// Limits on sentences pending translation across all models, checked on admission of a request. A value of 0 in
+    /// any field means no limit on the respective quantity.
+    BatchingPool::Stats maxPending;
+
+    /// Limits on sentences pending translation for any single model, checked on admission of a request.
+    BatchingPool::Stats maxPendingPerModel;
+
+    /// Whether any limit on pending sentences is set, which requires requests to go through admission.
+    bool limitsPending() const {
+      auto limits = [](const BatchingPool::Stats& limit) { return limit.sentences || limit.words || limit.bytes; };
+      return limits(maxPending) || limits(maxPendingPerModel);
+    }
+
+    template <class App>
+    static void addOptions(App& app, Config& config) {
+      app.add_option("--max-active-batches-per-model", config.maxActiveBatchesPerModel,
+                     "Maximum batches of a single model translated concurrently, 0 for no limit");
+      app.add_option("--max-pending-sentences", config.maxPending.sentences,
+                     "Maximum sentences pending translation, 0 for no limit");
+      app.add_option("--max-pending-words", config.maxPending.words,
+                     "Maximum words pending translation, 0 for no limit");
+      app.add_option("--max-pending-bytes", config.maxPending.bytes,
+                     "Maximum bytes of source text pending translation, 0 for no limit");
+      app.add_option("--max-pending-sentences-per-model", config.maxPendingPerModel.sentences,
+                     "Maximum sentences pending translation with a single model, 0 for no limit");
+      app.add_option("--max-pending-words-per-model", config.maxPendingPerModel.words,
+                     "Maximum words pending translation with a single model, 0 for no limit");
+      app.add_option("--max-pending-bytes-per-model", config.maxPendingPerModel.bytes,
+                     "Maximum bytes of source text pending translation with a single model, 0 for no limit");
+    }
+  };
+
+  /// Create an AggregateBatchingPool with global (across all BatchingPools) limits imposed here.
+  AggregateBatchingPool(const Config& config);
+
+  /// Create an AggregateBatchingPool without any global limits.
   AggregateBatchingPool();
 
+  /// Check whether request can be enqueued onto model within the limits on pending sentences in Config. A request is
+  /// always admitted into an empty pool (or model), so that a request larger than the limits can still be served.
+  ///
+  /// @param [in] model: Model the request is to be translated with.
+  /// @param [in] request: A request yet to be enqueued.
+  /// @returns true if enqueueing request would not exceed any of the limits.
+  bool admits(const Ptr<TranslationModel>& model, const Ptr<Request>& request) const;
+
+  /// Check whether requests can be enqueued onto model together, as above.
+  bool admits(const Ptr<TranslationModel>& model, const std::vector<Ptr<Request>>& requests) const;
+
   /// Enqueue an existing request onto model, also keep account of that this model and request are now pending.
   ///
   /// @param [in] model: Model to use in translation. A shared ownership to this model is accepted by this object to
@@ -51,19 +110,68 @@ class AggregateBatchingPool {
   /// @returns number of sentences added for translation.
   size_t enqueueRequest(Ptr<TranslationModel> model, Ptr<Request> request);
 
+  /// Enqueue requests onto model, in order.
+  ///
+  /// @returns number of sentences added for translation.
+  size_t enqueueRequest(Ptr<TranslationModel> model, const std::vector<Ptr<Request>>& requests);
+
   /// Generate a batch from pending requests, obtained from available TranslationModels.
   ///
   /// @param [out] model: TranslationModel
   /// @param [out] batch: Batch to write onto, which is consumed at translation elsewhere.
-  /// @returns Number of sentences in the generated batch.
+  /// @returns Number of sentences in the generated batch. Can be 0 while there are pending requests, if all of them
+  /// are for models at their limit of active batches.
   size_t generateBatch(Ptr<TranslationModel>& model, Batch& batch);
 
-  /// Clear the aggregate queue. Does not clear the underlying model/request pairs but the next call
-  /// to `generateBatch()` will return 0. (Unless `enqueueRequest()` was called in the mean time.)
+  /// Drops sentences of requests cancelled since last looked for from the pools of TranslationModels with pending
+  /// requests, so that they no longer count as pending. They are set aside for takeCancelled(...).
+  void dropCancelled();
+
+  /// Moves sentences of cancelled requests, dropped from the pools of TranslationModels in the course of
+  /// `generateBatch(...)` or `dropCancelled()`, into cancelled. These are yet to be completed, which is left to the
+  /// caller.
+  void takeCancelled(RequestSentences& cancelled);
+
+  /// Account for a batch generated from model through `generateBatch(...)` having completed translation.
+  ///
+  /// @param [in] model: TranslationModel the batch was generated from.
+  void releaseBatch(const Ptr<TranslationModel>& model);
+
+  /// Clear the aggregate queue, along with the requests pending in the BatchingPools of TranslationModels. Requests
+  /// share ownership of their model, so that requests left behind would keep it alive. The next call to
+  /// `generateBatch()` will return 0 (unless `enqueueRequest()` was called in the mean time).
   void clear();
 
+  /// Number of words pending translation, summed across all TranslationModels with pending requests.
+  size_t pendingWords() const;
+
+  /// Arrival of the sentence pending longest across all TranslationModels, or the latest representable time if none.
+  std::chrono::steady_clock::time_point oldestArrival();
+
+  /// Account of sentences pending translation, summed across all TranslationModels with pending requests.
+  BatchingPool::Stats pendingStats() const;
+
+  /// Account of sentences pending translation with model.
+  BatchingPool::Stats pendingStats(const Ptr<TranslationModel>& model) const;
+
  private:
-  std::unordered_set<std::shared_ptr<TranslationModel>, HashPtr<TranslationModel>> aggregateQueue_;
+  /// Scheduling state of a TranslationModel, kept while the model has pending requests or active batches.
+  struct Share {
+    double virtualTime{0};    ///< Words served, scaled by the inverse of weight.
+    size_t activeBatches{0};  ///< Batches generated and not yet released.
+    bool pending{false};      ///< Whether the model (possibly) has sentences left in its BatchingPool.
+  };
+
+  bool atLimit(const TranslationModel& model, const Share& share) const;
+
+  Config config_;
+  std::unordered_map<std::shared_ptr<TranslationModel>, Share, HashPtr<TranslationModel>> shares_;
+
+  /// Virtual time at the start of the most recently generated batch.
+  double virtualClock_{0};
+
+  /// Sentences of cancelled requests collected from TranslationModels, see takeCancelled(...).
+  RequestSentences cancelled_;
 };
 
 }  // namespace bergamot
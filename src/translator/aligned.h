@@ -18,10 +18,13 @@ namespace bergamot {
 
 template <class T> class AlignedVector {
   public:
-    AlignedVector() : mem_(nullptr), size_(0) {}
+    // Frees memory not allocated by this class, see the constructor taking one.
+    typedef void (*Deleter)(T *mem, std::size_t size);
+
+    AlignedVector() : mem_(nullptr), size_(0), deleter_(nullptr) {}
 
     explicit AlignedVector(std::size_t size, std::size_t alignment = 64 /* CPU cares about this */)
-      : size_(size) {
+      : size_(size), deleter_(nullptr) {
 #ifdef _MSC_VER
       mem_ = static_cast<T*>(_aligned_malloc(size * sizeof(T), alignment));
       if (!mem_) {
@@ -42,9 +45,14 @@ template <class T> class AlignedVector {
 #endif
     }
 
-    AlignedVector(AlignedVector &&from) : mem_(from.mem_), size_(from.size_) {
+    // Takes over size elements at mem obtained elsewhere (e.g. mapped from a file), aligned by whoever obtained them,
+    // to be freed with deleter.
+    AlignedVector(T *mem, std::size_t size, Deleter deleter) : mem_(mem), size_(size), deleter_(deleter) {}
+
+    AlignedVector(AlignedVector &&from) : mem_(from.mem_), size_(from.size_), deleter_(from.deleter_) {
       from.mem_ = nullptr;
       from.size_ = 0;
+      from.deleter_ = nullptr;
     }
 
     AlignedVector &operator=(AlignedVector &&from) {
@@ -52,8 +60,10 @@ template <class T> class AlignedVector {
       release();
       mem_ = from.mem_;
       size_ = from.size_;
+      deleter_ = from.deleter_;
       from.mem_ = nullptr;
       from.size_ = 0;
+      from.deleter_ = nullptr;
       return *this;
     }
 
@@ -78,8 +88,13 @@ template <class T> class AlignedVector {
   private:
     T *mem_;
     std::size_t size_;
+    Deleter deleter_;
 
     void release() {
+      if (deleter_) {
+        if (mem_) deleter_(mem_, size_);
+        return;
+      }
 #ifdef _MSC_VER
       _aligned_free(mem_);
 #else
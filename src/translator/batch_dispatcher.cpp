@@ -0,0 +1,257 @@
+#include "batch_dispatcher.h"
+
+#include "common/logging.h"
+#include "translation_model.h"
+
+namespace marian {
+namespace bergamot {
+
+BatchDispatcher::BatchDispatcher(size_t capacity, size_t numWorkers, size_t maxQueuedPerWorker)
+    : maxQueued_(maxQueuedPerWorker), numWorkers_(numWorkers) {
+  ABORT_IF(numWorkers > capacity, "Number of workers {} exceeds capacity of {}", numWorkers, capacity);
+  queues_.reserve(capacity);
+  for (size_t i = 0; i < capacity; i++) {
+    queues_.push_back(std::make_unique<WorkerQueue>());
+  }
+}
+
+bool BatchDispatcher::waitForRoom() {
+  std::unique_lock<std::mutex> lock(roomMutex_);
+  auto room = [this]() {
+    size_t numWorkers = numWorkers_.load();
+    if (maxQueued_ == 0) {
+      // Room only on a worker free to take the batch right away.
+      return queued_.load() + busy_.load() < numWorkers || shutdown_.load();
+    }
+    return queued_.load() < numWorkers * maxQueued_ || shutdown_.load();
+  };
+  room_.wait(lock, room);
+  return !shutdown_.load();
+}
+
+void BatchDispatcher::resize(size_t numWorkers) {
+  ABORT_IF(numWorkers > queues_.size(), "Number of workers {} exceeds capacity of {}", numWorkers, queues_.size());
+  numWorkers_.store(numWorkers);
+  notifyRoom();
+
+  // Workers to be spawned again take posts.
+  for (size_t i = 0; i < numWorkers; i++) {
+    std::lock_guard<std::mutex> lock(queues_[i]->mutex);
+    queues_[i]->retired = false;
+  }
+
+  // Retired workers waiting for a batch need to find out.
+  for (auto &queue : queues_) {
+    wake(*queue);
+  }
+}
+
+void BatchDispatcher::dispatch(Ptr<TranslationModel> model, Batch &&batch) {
+  // Ranks workers for the batch, higher is better: a sleeping worker can start right away, and one which has the model
+  // warm avoids a switch. Among equals, the shorter queue wins.
+  size_t modelId = model->modelId();
+  auto rank = [this, modelId](const WorkerQueue &queue) {
+    bool warm = queue.warm.load() && queue.warmModelId.load() == modelId;
+    return 2 * static_cast<int>(queue.sleeping.load()) + static_cast<int>(warm);
+  };
+
+  WorkerQueue *target = nullptr;
+  size_t numWorkers = numWorkers_.load();
+  for (size_t i = 0; i < numWorkers; i++) {
+    WorkerQueue *queue = queues_[i].get();
+    if (target == nullptr) {
+      target = queue;
+      continue;
+    }
+
+    bool full = queue->size.load() >= maxQueued_;
+    bool targetFull = target->size.load() >= maxQueued_;
+    if (full != targetFull) {
+      if (!full) {
+        target = queue;
+      }
+    } else if (rank(*queue) > rank(*target) ||
+               (rank(*queue) == rank(*target) && queue->size.load() < target->size.load())) {
+      target = queue;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(target->mutex);
+    target->items.push_back(Item{std::move(model), std::move(batch)});
+    target->size.fetch_add(1);
+    queued_.fetch_add(1);
+  }
+
+  // If the worker the batch went to is busy, have a sleeping worker steal it.
+  if (target->sleeping.load()) {
+    wake(*target);
+    return;
+  }
+
+  for (auto &queue : queues_) {
+    if (queue->sleeping.load()) {
+      wake(*queue);
+      return;
+    }
+  }
+}
+
+bool BatchDispatcher::post(size_t workerId, Task &&task) {
+  WorkerQueue &queue = *queues_[workerId];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.retired) {
+      return false;
+    }
+    queue.tasks.push_back(std::move(task));
+  }
+  queue.wakeup.notify_one();
+  return true;
+}
+
+bool BatchDispatcher::next(size_t workerId, Workspace &workspace, Ptr<TranslationModel> &model, Batch &batch) {
+  WorkerQueue &own = *queues_[workerId];
+  if (own.busy.exchange(false)) {
+    // Done with the batch in hand.
+    busy_.fetch_sub(1);
+    notifyRoom();
+  }
+
+  Item item;
+  while (true) {
+    runTasks(own, workspace);
+
+    if (workerId >= numWorkers_.load()) {
+      // Retired. Posts are turned down from now on, those made until now are run.
+      {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.retired = true;
+      }
+      runTasks(own, workspace);
+
+      // Anything left in own queue is up for stealing, by a worker which may have to be woken up for it, as the wake
+      // up on dispatch could have gone to this one.
+      if (queued_.load() > 0) {
+        size_t numWorkers = numWorkers_.load();
+        for (size_t i = 0; i < numWorkers; i++) {
+          if (queues_[i]->sleeping.load()) {
+            wake(*queues_[i]);
+            break;
+          }
+        }
+      }
+      return false;
+    }
+
+    // Counted busy ahead of taking a batch, so that the room the batch leaves in the queues is never mistaken for room
+    // on an idle worker.
+    busy_.fetch_add(1);
+    if (take(own, /*modelId=*/nullptr, item) || steal(workerId, item)) {
+      own.busy.store(true);
+      notifyRoom();
+
+      own.warmModelId.store(item.model->modelId());
+      own.warm.store(true);
+      model = std::move(item.model);
+      batch = std::move(item.batch);
+      return true;
+    }
+    busy_.fetch_sub(1);
+    notifyRoom();
+
+    // Going to sleep is announced before checking for work, pairing with dispatch(...) checking for sleeping workers
+    // after queueing a batch, so that a batch is never left queued with every worker asleep.
+    std::unique_lock<std::mutex> lock(own.mutex);
+    own.sleeping.store(true);
+    own.wakeup.wait(lock, [this, workerId, &own]() {
+      return queued_.load() > 0 || shutdown_.load() || workerId >= numWorkers_.load() || !own.tasks.empty();
+    });
+    own.sleeping.store(false);
+    if (queued_.load() == 0 && shutdown_.load()) {
+      own.retired = true;
+      lock.unlock();
+      runTasks(own, workspace);
+      return false;
+    }
+  }
+}
+
+void BatchDispatcher::shutdown() {
+  shutdown_.store(true);
+  notifyRoom();
+
+  for (auto &queue : queues_) {
+    wake(*queue);
+  }
+}
+
+void BatchDispatcher::runTasks(WorkerQueue &queue, Workspace &workspace) {
+  // Tasks posted in the meantime are left for the next call, so that a stream of posts does not keep the worker from
+  // finding out it is retired.
+  std::deque<Task> tasks;
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    tasks.swap(queue.tasks);
+  }
+  for (Task &task : tasks) {
+    task(workspace);
+  }
+}
+
+bool BatchDispatcher::take(WorkerQueue &queue, const size_t *modelId, Item &item) {
+  if (queue.size.load() == 0) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  for (auto itr = queue.items.begin(); itr != queue.items.end(); ++itr) {
+    if (modelId == nullptr || itr->model->modelId() == *modelId) {
+      item = std::move(*itr);
+      queue.items.erase(itr);
+      queue.size.fetch_sub(1);
+      queued_.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool BatchDispatcher::steal(size_t workerId, Item &item) {
+  // Oldest batches first, for latency. A batch of the model this worker has warm is preferred, if there is one.
+  const WorkerQueue &own = *queues_[workerId];
+  if (own.warm.load()) {
+    size_t modelId = own.warmModelId.load();
+    for (size_t i = 1; i < queues_.size(); i++) {
+      if (take(*queues_[(workerId + i) % queues_.size()], &modelId, item)) {
+        return true;
+      }
+    }
+  }
+
+  for (size_t i = 1; i < queues_.size(); i++) {
+    if (take(*queues_[(workerId + i) % queues_.size()], /*modelId=*/nullptr, item)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void BatchDispatcher::notifyRoom() {
+  // Taking the lock ensures the batch-forming thread is either yet to check for room, or already waiting.
+  {
+    std::lock_guard<std::mutex> lock(roomMutex_);
+  }
+  room_.notify_all();
+}
+
+void BatchDispatcher::wake(WorkerQueue &queue) {
+  // Taking the lock ensures the worker is either yet to check for work, or already waiting.
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+  }
+  queue.wakeup.notify_one();
+}
+
+}  // namespace bergamot
+}  // namespace marian
@@ -0,0 +1,133 @@
+#ifndef SRC_BERGAMOT_BATCH_DISPATCHER_H_
+#define SRC_BERGAMOT_BATCH_DISPATCHER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "batch.h"
+#include "data/types.h"
+
+namespace marian {
+namespace bergamot {
+
+class TranslationModel;
+class Workspace;
+
+/// Hands batches formed by a single batch-forming thread over to worker threads, through a queue per worker.
+///
+/// A batch goes to the queue of a worker which has last translated a batch of the same TranslationModel if possible,
+/// so that workers keep working with the backend (graph, parameters, workspace) they have warm in cache. A worker takes
+/// batches from its own queue first, and once that is empty, steals from the queues of other workers (preferring
+/// batches of its warm model), so that no worker idles while there is work queued elsewhere. Workers contend only on
+/// the queue they take from, instead of all of them on a single pool.
+///
+/// Queues are bounded in depth, and the batch-forming thread is held back while all are full. This keeps batches from
+/// being formed long before a worker is available, when they could still change by more urgent requests arriving. At a
+/// depth of 0, nothing is queued ahead: a batch is formed only once a worker is free to take it right away, so that an
+/// urgent request arriving while all workers are busy goes into the very next batch.
+///
+/// The number of workers can change at runtime, up to a capacity fixed on construction, see resize(...).
+///
+/// Besides batches, work can be posted to a specific worker, to run with its workspace (see post(...)).
+class BatchDispatcher {
+ public:
+  /// Work for a specific worker, run with the workspace of the worker.
+  using Task = std::function<void(Workspace &)>;
+
+  /// @param [in] capacity: Maximum number of workers.
+  /// @param [in] numWorkers: Number of worker threads, identified by 0 to numWorkers - 1.
+  /// @param [in] maxQueuedPerWorker: Maximum batches queued per worker, excluding the one in translation. 0 queues a
+  /// batch only for a worker free to translate it.
+  BatchDispatcher(size_t capacity, size_t numWorkers, size_t maxQueuedPerWorker);
+
+  /// Blocks the batch-forming thread until there is room in the queues for another batch. Returns false once shut down.
+  bool waitForRoom();
+
+  /// Queues batch of model for translation on one of the workers.
+  void dispatch(Ptr<TranslationModel> model, Batch &&batch);
+
+  /// Queues task to run on the worker identified by workerId, ahead of any batches. Unlike batches, tasks are never
+  /// taken by another worker. A worker runs every task posted before it retires or shuts down. Returns false, with task
+  /// not run, if the worker has retired or shut down already (see resize(...)), which can be the case even if workerId
+  /// was below numWorkers() just before.
+  bool post(size_t workerId, Task &&task);
+
+  /// Obtains the next batch to translate for the worker identified by workerId, waiting for one if there is none.
+  /// Tasks posted for the worker are run on workspace in the meantime. Returns false once shut down with no batches
+  /// left to translate, or once the worker is retired by resize(...).
+  bool next(size_t workerId, Workspace &workspace, Ptr<TranslationModel> &model, Batch &batch);
+
+  /// Changes the number of workers to numWorkers, at most capacity. Workers identified by numWorkers and above are
+  /// retired: they get no more batches, and are returned false from next(...) once done with the batch in hand. Batches
+  /// left in their queues are stolen by the remaining workers. Workers added must start calling next(...) after.
+  void resize(size_t numWorkers);
+
+  /// Number of workers in use, as last set.
+  size_t numWorkers() const { return numWorkers_.load(); }
+
+  /// Maximum number of workers, as constructed with.
+  size_t capacity() const { return queues_.size(); }
+
+  /// Signals that no more batches will be dispatched. Workers finish translating batches already queued.
+  void shutdown();
+
+ private:
+  struct Item {
+    Ptr<TranslationModel> model;
+    Batch batch;
+  };
+
+  /// Kept on its own cache line to avoid false sharing between workers.
+  struct alignas(64) WorkerQueue {
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<Item> items;
+    std::deque<Task> tasks;
+    std::atomic<size_t> size{0};         ///< Size of items, readable without the lock.
+    std::atomic<bool> sleeping{false};   ///< Whether the worker is waiting for a batch.
+    std::atomic<bool> busy{false};       ///< Whether the worker has a batch in hand.
+    std::atomic<size_t> warmModelId{0};  ///< modelId of the TranslationModel last translated.
+    std::atomic<bool> warm{false};       ///< Whether warmModelId is valid.
+    bool retired{false};                 ///< Whether the worker has returned false from next(...), under mutex.
+  };
+
+  /// Runs the tasks in queue as of the call, in order of posting.
+  void runTasks(WorkerQueue &queue, Workspace &workspace);
+
+  /// Takes the oldest batch in queue, or the oldest of the model identified by modelId if not null.
+  bool take(WorkerQueue &queue, const size_t *modelId, Item &item);
+
+  /// Takes a batch from the queue of a worker other than the one identified by workerId, including retired workers.
+  bool steal(size_t workerId, Item &item);
+
+  /// Wakes up the worker of queue, if sleeping.
+  void wake(WorkerQueue &queue);
+
+  /// Wakes up the batch-forming thread, if waiting for room.
+  void notifyRoom();
+
+  size_t maxQueued_;
+
+  /// A queue for each worker up to capacity, of which the first numWorkers_ are in use.
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::atomic<size_t> numWorkers_;
+
+  /// Batches across all queues.
+  std::atomic<size_t> queued_{0};
+  /// Workers with a batch in hand, or about to take one.
+  std::atomic<size_t> busy_{0};
+  std::atomic<bool> shutdown_{false};
+
+  std::mutex roomMutex_;
+  std::condition_variable room_;
+};
+
+}  // namespace bergamot
+}  // namespace marian
+
+#endif  // SRC_BERGAMOT_BATCH_DISPATCHER_H_
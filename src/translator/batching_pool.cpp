@@ -1,6 +1,11 @@
 #include "batching_pool.h"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <tuple>
 
 #include "batch.h"
 #include "common/logging.h"
@@ -8,8 +13,43 @@
 namespace marian {
 namespace bergamot {
 
+void OutputLengthEstimator::observe(size_t sourceLength, size_t targetLength) {
+  if (sourceLength == 0) {
+    return;
+  }
+
+  // Running mean over the first observations, moving average with a fixed decay after, to follow drift in traffic.
+  float ratio = static_cast<float>(targetLength) / static_cast<float>(sourceLength);
+  auto update = [ratio](Ratio &average) {
+    average.observations += 1;
+    float weight = std::max(kDecay, 1.0f / static_cast<float>(average.observations));
+    average.value += weight * (ratio - average.value);
+  };
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (sourceLength >= byLength_.size()) {
+    byLength_.resize(sourceLength + 1);
+  }
+  update(overall_);
+  update(byLength_[sourceLength]);
+}
+
+void OutputLengthEstimator::predict(size_t maxSourceLength, std::vector<size_t> &predicted) const {
+  predicted.resize(maxSourceLength + 1);
+  std::lock_guard<std::mutex> guard(mutex_);
+  for (size_t length = 0; length <= maxSourceLength; length++) {
+    const Ratio &ratio = (length < byLength_.size() && byLength_[length].observations >= kMinObservations)
+                             ? byLength_[length]
+                             : overall_;
+    predicted[length] = static_cast<size_t>(std::lround(ratio.value * length));
+  }
+}
+
 BatchingPool::BatchingPool(Ptr<Options> options)
-    : miniBatchWords_(options->get<int>("mini-batch-words")), maxActiveBucketLength_(0) {
+    : maxLengthRatio_(options->get<float>("max-batch-length-ratio", 0.0f)),
+      maxPassedOver_(options->get<size_t>("max-batches-passed-over", 16)),
+      budgetTarget_(options->get<bool>("budget-target-words", false)),
+      maxActiveBucketLength_(0) {
   size_t maxLengthBreak = options->get<int>("max-length-break");
   float maxLengthFactor = options->get<float>("max-length-factor", 3.0);
 
@@ -21,39 +61,195 @@ BatchingPool::BatchingPool(Ptr<Options> options)
   size_t pivotSlack = maxLengthBreak * maxLengthFactor - maxLengthBreak;
   bucket_.resize(maxLengthBreak + pivotSlack + 1);
 
-  ABORT_IF(bucket_.size() - 1 > miniBatchWords_,
+  size_t miniBatchWords = options->get<int>("mini-batch-words");
+  ABORT_IF(bucket_.size() - 1 > miniBatchWords,
            "Fatal: max-length-break > mini-batch-words  will lead to sentences "
            "longer than what can fit in a batch.");
+
+  // Bounds for auto-tuning default to a factor of 4 either way of mini-batch-words, but no lower than what fits the
+  // longest sentence.
+  size_t minWords = options->get<size_t>("min-mini-batch-words", 0);
+  size_t maxWords = options->get<size_t>("max-mini-batch-words", 0);
+  minWords = minWords > 0 ? minWords : std::max(miniBatchWords / 4, bucket_.size() - 1);
+  maxWords = maxWords > 0 ? maxWords : 4 * miniBatchWords;
+  bool autotune = options->get<bool>("autotune-mini-batch-words", false);
+  ABORT_IF(autotune && (minWords < bucket_.size() - 1 || minWords > miniBatchWords || maxWords < miniBatchWords),
+           "Fatal: min-mini-batch-words <= mini-batch-words <= max-mini-batch-words is required, with sentences no "
+           "longer than min-mini-batch-words.");
+  miniBatchWords_ = New<MiniBatchWordsTuner>(miniBatchWords, minWords, maxWords, autotune);
+
+  ABORT_IF(maxLengthRatio_ != 0.0f && maxLengthRatio_ < 1.0f, "Fatal: max-batch-length-ratio must be at least 1.");
 }
 
 size_t BatchingPool::generateBatch(Batch &batch) {
-  // For now simply iterates on buckets and converts batches greedily.  This
-  // has to be enhanced with optimizing over priority. The baseline
-  // implementation should at least be as fast as marian's maxi-batch with full
-  // corpus size as maxi-batch size.
+  // Within a bucket, sentences are ordered by the urgency of the Request they come from (see Request::operator<).
+  // The most urgent sentence in the pool is therefore at the head of one of the buckets. The batch is anchored at this
+  // sentence, which ensures no sentence waits indefinitely on account of its length, as was the case with greedily
+  // filling from the shortest bucket. It does not keep a less urgent sentence from waiting indefinitely behind a steady
+  // stream of more urgent ones though: a sentence which has been passed over by max-batches-passed-over batches since
+  // it arrived anchors the batch instead.
+  //
+  // A batch is decoded until its longest translation completes, while rows of sentences finished early idle. The rest
+  // of the batch is therefore filled with sentences whose translations are predicted (see OutputLengthEstimator) to be
+  // closest in length to that of the anchor, for as long as the batch stays within mini-batch-words. The size of a
+  // batch is its rows times the padded source length, or with budget-target-words, the longer of the padded source and
+  // the predicted padded target. Within each length, more urgent sentences go first. If max-batch-length-ratio is set,
+  // predicted lengths in the batch are additionally kept within that ratio of each other, at the expense of smaller
+  // batches.
+  //
+  // Sentences of cancelled requests are dropped first, wherever they are in their buckets. Those of expired requests
+  // are dropped lazily, as they come up at the head of a bucket: within a priority, sentences due earliest are at the
+  // head.
   batch.clear();
-  size_t paddedBatchSize = 0;
+  dropCancelled();
+
+  Deadline now = std::chrono::steady_clock::now();
+  auto dropExpired = [this, now](size_t length) {
+    while (!bucket_[length].empty() && bucket_[length].begin()->first.abandoned(now)) {
+      cancelled_.push_back(take(length));
+    }
+  };
 
+  bool found = false;
+  size_t anchorLength = 0;
+  std::vector<size_t> lengths;
   for (size_t length = 0; length <= maxActiveBucketLength_; length++) {
-    auto p = bucket_[length].begin();
-    while (p != bucket_[length].end()) {
-      paddedBatchSize = (batch.size() + 1) * length;
-      if (paddedBatchSize <= miniBatchWords_) {
-        auto q = p++;
-        batch.add(*q);
-        bucket_[length].erase(q);
-      } else {
-        // Check if elements exist
-        assert(batch.size() > 0);
+    dropExpired(length);
+    if (!bucket_[length].empty()) {
+      lengths.push_back(length);
+      if (!found || bucket_[length].begin()->first < bucket_[anchorLength].begin()->first) {
+        anchorLength = length;
+        found = true;
+      }
+    }
+  }
+
+  if (!found) {
+    return 0;
+  }
+
+  std::optional<Bucket::iterator> anchor = overdue(now);
+  if (anchor) {
+    anchorLength = (*anchor)->first.numTokens();
+  }
+  batchNumber_ += 1;
+
+  outputLength_.predict(maxActiveBucketLength_, predicted_);
+  const std::vector<size_t> &predicted = predicted_;
+  auto distance = [](size_t a, size_t b) { return a > b ? a - b : b - a; };
+
+  // Visit lengths by how close their predicted output is to that of the anchor, the anchor first. Ties go to the source
+  // length closer to that of the anchor, shorter first.
+  std::sort(lengths.begin(), lengths.end(), [&](size_t a, size_t b) {
+    size_t anchorOutput = predicted[anchorLength];
+    return std::make_tuple(distance(predicted[a], anchorOutput), distance(a, anchorLength), a) <
+           std::make_tuple(distance(predicted[b], anchorOutput), distance(b, anchorLength), b);
+  });
+
+  size_t miniBatchWords = miniBatchWords_->value();
+  size_t longestSource = 0;
+  size_t longestOutput = 0;
+  size_t shortestOutput = std::numeric_limits<size_t>::max();
+  if (anchor) {
+    batch.add(take(anchorLength, *anchor));
+    longestSource = anchorLength;
+    longestOutput = shortestOutput = predicted[anchorLength];
+  }
+
+  for (size_t length : lengths) {
+    size_t output = predicted[length];
+    size_t shortest = std::min(shortestOutput, output);
+    size_t longest = std::max(longestOutput, output);
+    if (maxLengthRatio_ != 0.0f && longest > maxLengthRatio_ * std::max<size_t>(shortest, 1)) {
+      continue;
+    }
+
+    // Moves sentences from the bucket into batch for as long as the padded batch fits. Once the batch cannot take any
+    // more at this length, it is considered full.
+    size_t padded = std::max(longestSource, length);
+    if (budgetTarget_) {
+      padded = std::max(padded, longest);
+    }
+    auto &bucket = bucket_[length];
+    for (dropExpired(length); !bucket.empty(); dropExpired(length)) {
+      // The anchor always makes it in, even if it (grown dynamically, see enqueueRequest) exceeds mini-batch-words.
+      if ((batch.size() + 1) * padded > miniBatchWords && batch.size() > 0) {
         return batch.size();
       }
+      batch.add(take(length));
+      longestSource = std::max(longestSource, length);
+      longestOutput = longest;
+      shortestOutput = shortest;
     }
   }
 
+  assert(batch.size() > 0);
   return batch.size();
 }
 
+RequestSentence BatchingPool::take(size_t length) { return take(length, bucket_[length].begin()); }
+
+RequestSentence BatchingPool::take(size_t length, Bucket::iterator itr) {
+  RequestSentence sentence = itr->first;
+  arrivals_.erase(itr->second);
+  bucket_[length].erase(itr);
+  stats_.sentences -= 1;
+  stats_.words -= sentence.numTokens();
+  stats_.bytes -= sentence.numBytes();
+  return sentence;
+}
+
+std::chrono::steady_clock::time_point BatchingPool::oldestArrival() const {
+  return arrivals_.empty() ? std::chrono::steady_clock::time_point::max()
+                           : arrivals_.begin()->second.sentence->first.arrival();
+}
+
+std::optional<BatchingPool::Bucket::iterator> BatchingPool::overdue(Deadline now) {
+  if (maxPassedOver_ == 0) {
+    return std::nullopt;
+  }
+
+  while (!arrivals_.empty()) {
+    const Arrival &arrival = arrivals_.begin()->second;
+    if (arrival.sentence->first.abandoned(now)) {
+      cancelled_.push_back(take(arrival.length, arrival.sentence));
+    } else if (batchNumber_ - arrival.batchNumber >= maxPassedOver_) {
+      return arrival.sentence;
+    } else {
+      return std::nullopt;
+    }
+  }
+  return std::nullopt;
+}
+
+void BatchingPool::dropCancelled() {
+  size_t cancellations = cancellations_->load(std::memory_order_acquire);
+  if (cancellations == cancellationsSeen_) {
+    return;
+  }
+
+  // Read ahead of looking, so that a cancellation coming in while looking is looked for again next time.
+  cancellationsSeen_ = cancellations;
+  Deadline now = std::chrono::steady_clock::now();
+  for (size_t length = 0; length <= maxActiveBucketLength_ && length < bucket_.size(); length++) {
+    auto &bucket = bucket_[length];
+    for (auto itr = bucket.begin(); itr != bucket.end();) {
+      if (itr->first.abandoned(now)) {
+        cancelled_.push_back(take(length, itr++));
+      } else {
+        ++itr;
+      }
+    }
+  }
+}
+
+void BatchingPool::takeCancelled(RequestSentences &cancelled) {
+  cancelled.insert(cancelled.end(), cancelled_.begin(), cancelled_.end());
+  cancelled_.clear();
+}
+
 size_t BatchingPool::enqueueRequest(Ptr<Request> request) {
+  request->handle().watch(cancellations_);
   size_t toBeFreshlyTranslated = 0;
   for (size_t i = 0; i < request->numSegments(); i++) {
     if (!request->cacheHitPrefilled(i)) {
@@ -69,7 +265,11 @@ size_t BatchingPool::enqueueRequest(Ptr<Request> request) {
         bucket_.resize(bucket_id + 1);
       }
 
-      bucket_[bucket_id].insert(sentence);
+      auto itr = bucket_[bucket_id].emplace(sentence, arrivalsSeen_).first;
+      arrivals_.emplace(arrivalsSeen_++, Arrival{batchNumber_, bucket_id, itr});
+      stats_.sentences += 1;
+      stats_.words += bucket_id;
+      stats_.bytes += sentence.numBytes();
       maxActiveBucketLength_ = std::max<size_t>(bucket_id, maxActiveBucketLength_);
 
       toBeFreshlyTranslated += 1;
@@ -79,10 +279,24 @@ size_t BatchingPool::enqueueRequest(Ptr<Request> request) {
   return toBeFreshlyTranslated;
 }
 
+BatchingPool::Stats BatchingPool::toBeTranslated(const Request &request) {
+  Stats stats;
+  for (size_t i = 0; i < request.numSegments(); i++) {
+    if (!request.cacheHitPrefilled(i)) {
+      stats.sentences += 1;
+      stats.words += request.segmentTokens(i);
+      stats.bytes += request.segmentBytes(i);
+    }
+  }
+  return stats;
+}
+
 void BatchingPool::clear() {
   for (size_t length = 0; length < bucket_.size(); length++) {
     bucket_[length].clear();
   }
+  arrivals_.clear();
+  stats_ = Stats();
 }
 
 }  // namespace bergamot
@@ -1,20 +1,63 @@
 #ifndef SRC_BERGAMOT_BATCHING_POOL_H_
 #define SRC_BERGAMOT_BATCHING_POOL_H_
 
-#include <set>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
 #include <vector>
 
 #include "batch.h"
 #include "common/options.h"
 #include "data/corpus_base.h"
 #include "definitions.h"
+#include "mini_batch_words_tuner.h"
 #include "request.h"
 
 namespace marian {
 namespace bergamot {
 
+/// Predicts the length of the translation of a sentence from its length in tokens, so that sentences expected to
+/// finish decoding close together can be batched together. Learns the ratio of target to source length online from
+/// completed translations, for each source length as well as overall. Lengths not observed often enough fall back on
+/// the overall ratio, which starts out at 1.
+///
+/// Thread-safe, as translations complete on workers concurrently with batches being generated.
+class OutputLengthEstimator {
+ public:
+  /// Records the length of a completed translation.
+  void observe(size_t sourceLength, size_t targetLength);
+
+  /// Writes predicted target lengths, indexed by source lengths 0 to maxSourceLength, into predicted. Taking the vector
+  /// from the caller lets it reuse the allocation from one batch to the next.
+  void predict(size_t maxSourceLength, std::vector<size_t> &predicted) const;
+
+ private:
+  struct Ratio {
+    float value{1.0f};
+    size_t observations{0};
+  };
+
+  static constexpr float kDecay = 0.05f;         // Weight of a new observation, once past warm up.
+  static constexpr size_t kMinObservations = 8;  // Observations before the ratio for a source length is trusted.
+
+  mutable std::mutex mutex_;
+  Ratio overall_;
+  std::vector<Ratio> byLength_;
+};
+
 class BatchingPool {
  public:
+  // Account of sentences pending translation. Also used to express limits on the same, where 0 means no limit.
+  struct Stats {
+    size_t sentences{0};  ///< Number of sentences.
+    size_t words{0};      ///< Number of words (subword tokens) across sentences.
+    size_t bytes{0};      ///< Size of the source text of sentences in bytes.
+  };
+
   explicit BatchingPool(Ptr<Options> options);
 
   // RequestSentence incorporates (tentative) notions of priority with each
@@ -23,16 +66,86 @@ class BatchingPool {
   size_t enqueueRequest(Ptr<Request> request);
 
   // Loads sentences with sentences compiled from (tentatively) multiple
-  // requests optimizing for both padding and priority.
+  // requests optimizing for both padding and priority. The most urgent pending
+  // sentence is always included, unless a sentence has been passed over by
+  // max-batches-passed-over batches, which is included instead. Sentences of
+  // cancelled or expired requests are removed from the pool on the way, see
+  // takeCancelled(...).
   size_t generateBatch(Batch &batch);
 
+  // Removes sentences of cancelled requests from the pool, so that they no longer count in stats(), if any request has
+  // been cancelled since the pool was last looked through. Sentences of expired requests found on the way are removed
+  // too. Cheap if there has been no cancellation, for use before every look at stats().
+  void dropCancelled();
+
+  // Moves sentences of cancelled or expired requests removed from the pool into cancelled, to be completed (without
+  // translation) by the caller. Completion is left to the caller as it triggers client callbacks, which should not
+  // happen with locks held.
+  void takeCancelled(RequestSentences &cancelled);
+
   // Removes any pending requests from the pool.
   void clear();
 
+  // Number of words (tokens) in sentences pending in the pool.
+  size_t pendingWords() const { return stats_.words; }
+
+  // Arrival (see RequestSentence::arrival()) of the sentence enqueued earliest of those pending in the pool, or the
+  // latest representable time if there is none.
+  std::chrono::steady_clock::time_point oldestArrival() const;
+
+  // Account of sentences pending in the pool.
+  const Stats &stats() const { return stats_; }
+
+  // Estimates of output length used in packing batches, to be fed with translations as they complete.
+  OutputLengthEstimator &outputLength() { return outputLength_; }
+
+  // Budget of words in a batch (mini-batch-words), to be fed with timings of batches as they complete if auto-tuned.
+  MiniBatchWordsTuner &miniBatchWords() { return *miniBatchWords_; }
+
+  // Account of sentences in request which would be added to the pool on enqueue, i.e. those not prefilled from cache.
+  static Stats toBeTranslated(const Request &request);
+
  private:
-  size_t miniBatchWords_;
-  std::vector<std::set<RequestSentence>> bucket_;
-  size_t batchNumber_{0};
+  // Removes the most urgent sentence of length from the pool.
+  RequestSentence take(size_t length);
+
+  // Sentences pending at one length, each with the key of its entry in arrivals_.
+  using Bucket = std::map<RequestSentence, size_t>;
+
+  // Removes the sentence at itr in the bucket of length from the pool.
+  RequestSentence take(size_t length, Bucket::iterator itr);
+
+  // The sentence pending longest, if it has been passed over by maxPassedOver_ batches. Sentences of expired requests
+  // found on the way are dropped.
+  std::optional<Bucket::iterator> overdue(Deadline now);
+
+  // Where a pending sentence sits in bucket_, with batchNumber_ as of its arrival.
+  struct Arrival {
+    size_t batchNumber;
+    size_t length;
+    Bucket::iterator sentence;
+  };
+
+  Ptr<MiniBatchWordsTuner> miniBatchWords_;  // Budget of words in a batch, possibly auto-tuned.
+  float maxLengthRatio_;  // Bound on longest to shortest sentence in a batch, 0 for no bound.
+  size_t maxPassedOver_;  // Bound on batches formed while a sentence waits, 0 for no bound.
+  bool budgetTarget_;     // Whether predicted target words count against mini-batch-words, as well as source words.
+  Stats stats_;
+  OutputLengthEstimator outputLength_;
+  std::vector<size_t> predicted_;  // Predicted target lengths by source length, for the batch being generated.
+  std::vector<Bucket> bucket_;
+  RequestSentences cancelled_;
+  // Cancellations of requests enqueued, counted by their handles (see RequestHandle::watch), and the count as of the
+  // last look through the pool.
+  std::shared_ptr<std::atomic<size_t>> cancellations_{std::make_shared<std::atomic<size_t>>(0)};
+  size_t cancellationsSeen_{0};
+  size_t batchNumber_{0};  // Batches generated so far.
+
+  // Pending sentences in order of arrival, for maxPassedOver_ and oldestArrival(). Entries point into bucket_ rather
+  // than hold sentences, and leave with their sentence in take(): a sentence holds its Request, which holds the model
+  // owning this pool.
+  std::map<size_t, Arrival> arrivals_;
+  size_t arrivalsSeen_{0};  // Key of the next entry in arrivals_.
   size_t maxActiveBucketLength_;
 };
 
@@ -0,0 +1,108 @@
+#ifndef SRC_BERGAMOT_BOUNDED_QUEUE_H_
+#define SRC_BERGAMOT_BOUNDED_QUEUE_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace marian {
+namespace bergamot {
+
+/// A bounded multi-producer multi-consumer queue which does not take locks, after Dmitry Vyukov's design
+/// (https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue).
+///
+/// Each cell carries a sequence number which tells producers and consumers whether it is free to be written or ready to
+/// be read for the position they have claimed. Producers and consumers claim positions with a compare-and-swap on
+/// separate counters, so that they only contend among themselves, and never on a lock. Operations do not wait: a push
+/// to a full queue or a pop from an empty queue fails, and it is up to the caller to fall back or retry.
+template <class T>
+class BoundedQueue {
+ public:
+  /// Constructs a queue holding up to capacity items. Capacity is required to be a power of two, at least 2.
+  explicit BoundedQueue(size_t capacity) : cells_(new Cell[capacity]), mask_(capacity - 1) {
+    assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+    for (size_t i = 0; i < capacity; i++) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    enqueuePosition_.store(0, std::memory_order_relaxed);
+    dequeuePosition_.store(0, std::memory_order_relaxed);
+  }
+
+  BoundedQueue(const BoundedQueue &) = delete;
+  BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+  /// Pushes item into the queue. Returns false, leaving item untouched, if the queue is full.
+  bool tryPush(T &&item) {
+    Cell *cell;
+    size_t position = enqueuePosition_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[position & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+      if (difference == 0) {
+        // Free for writing at position, claim it.
+        if (enqueuePosition_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (difference < 0) {
+        // Not yet read since the previous lap: full.
+        return false;
+      } else {
+        position = enqueuePosition_.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->item = std::move(item);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Pops the oldest item in the queue into item. Returns false if the queue is empty.
+  bool tryPop(T &item) {
+    Cell *cell;
+    size_t position = dequeuePosition_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[position & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+      if (difference == 0) {
+        // Written for position, claim it.
+        if (dequeuePosition_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (difference < 0) {
+        // Not yet written: empty.
+        return false;
+      } else {
+        position = dequeuePosition_.load(std::memory_order_relaxed);
+      }
+    }
+
+    item = std::move(cell->item);
+    cell->item = T();
+    cell->sequence.store(position + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T item;
+  };
+
+  static constexpr size_t kCacheLineSize = 64;
+
+  std::unique_ptr<Cell[]> cells_;
+  const size_t mask_;
+
+  // Kept on separate cache lines, so that producers and consumers do not invalidate each other's.
+  alignas(kCacheLineSize) std::atomic<size_t> enqueuePosition_;
+  alignas(kCacheLineSize) std::atomic<size_t> dequeuePosition_;
+};
+
+}  // namespace bergamot
+}  // namespace marian
+
+#endif  // SRC_BERGAMOT_BOUNDED_QUEUE_H_
@@ -1,11 +1,23 @@
 #include "byte_array_util.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <future>
 #include <memory>
 
 #include "common/io.h"
 #include "data/shortlist.h"
 
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define BERGAMOT_MMAP
+#endif
+
 namespace marian {
 namespace bergamot {
 
@@ -29,6 +41,62 @@ const T* get(const void*& current, uint64_t num = 1) {
   current = (const T*)current + num;
   return ptr;
 }
+
+// Also copied from marian's src/common/binary.cpp.
+const uint64_t kBinaryFileVersion = 1;
+
+// Alignment of the model in memory, and of each parameter within it when laid out by binaryModelFromItems(...).
+const size_t kModelAlignment = 256;
+
+size_t alignUp(size_t size) { return (size + kModelAlignment - 1) / kModelAlignment * kModelAlignment; }
+
+// Lays out items in memory in marian's binary model format, as marian-conv would write them to a .bin file. Data of
+// each item is padded to keep the next aligned, as graphs map parameters from this memory rather than copying them.
+AlignedMemory binaryModelFromItems(const std::vector<io::Item>& items) {
+  std::vector<Header> headers;
+  uint64_t position = 2 * sizeof(uint64_t) + items.size() * sizeof(Header);
+  for (const io::Item& item : items) {
+    headers.push_back(Header{item.name.size() + 1, static_cast<uint64_t>(item.type), item.shape.size(),
+                             alignUp(item.size())});
+    position += headers.back().nameLength + headers.back().shapeLength * sizeof(int);
+  }
+
+  // Data starts aligned, after padding preceded by its length.
+  uint64_t padding = alignUp(position + sizeof(uint64_t)) - position - sizeof(uint64_t);
+  uint64_t modelSize = position + sizeof(uint64_t) + padding;
+  for (const Header& header : headers) {
+    modelSize += header.dataLength;
+  }
+
+  AlignedMemory model(modelSize, kModelAlignment);
+  std::fill(model.begin(), model.end(), 0);
+  char* current = model.begin();
+  auto write = [&current](const void* data, size_t size) {
+    std::memcpy(current, data, size);
+    current += size;
+  };
+
+  uint64_t numHeaders = headers.size();
+  write(&kBinaryFileVersion, sizeof(uint64_t));
+  write(&numHeaders, sizeof(uint64_t));
+  write(headers.data(), headers.size() * sizeof(Header));
+  for (const io::Item& item : items) {
+    write(item.name.c_str(), item.name.size() + 1);
+  }
+  for (const io::Item& item : items) {
+    for (size_t i = 0; i < item.shape.size(); i++) {
+      int dim = item.shape[i];
+      write(&dim, sizeof(int));
+    }
+  }
+  write(&padding, sizeof(uint64_t));
+  current += padding;
+  for (size_t i = 0; i < items.size(); i++) {
+    write(items[i].data(), items[i].size());
+    current += headers[i].dataLength - items[i].size();
+  }
+  return model;
+}
 }  // Anonymous namespace
 
 bool validateBinaryModel(const AlignedMemory& model, uint64_t fileSize) {
@@ -91,17 +159,56 @@ AlignedMemory loadFileToMemory(const std::string& path, size_t alignment) {
   return alignedMemory;
 }
 
+AlignedMemory mapFileToMemory(const std::string& path, size_t alignment) {
+  return mapFileToMemory(path, alignment, /*offset=*/0, filesystem::fileSize(path));
+}
+
+AlignedMemory mapFileToMemory(const std::string& path, size_t alignment, size_t offset, size_t size) {
+  if (size == 0) {
+    return AlignedMemory();
+  }
+#ifdef BERGAMOT_MMAP
+  int fd = open(path.c_str(), O_RDONLY);
+  ABORT_IF(fd == -1, "Failed opening file: {}", path);
+
+  // Private, so that a stray write goes to a copy of the page instead of the file. Pages never written to, which is
+  // all of them, stay shared.
+  void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, static_cast<off_t>(offset));
+  close(fd);
+  ABORT_IF(mem == MAP_FAILED, "Failed mapping {} bytes at offset {} of file: {}", size, offset, path);
+
+  // Mappings start at a page boundary, which is aligned enough for anything asked for here.
+  ABORT_IF(reinterpret_cast<uintptr_t>(mem) % alignment != 0, "Mapping of {} is not aligned to {} bytes", path,
+           alignment);
+  return AlignedMemory(static_cast<char*>(mem), size, [](char* mem, size_t size) { munmap(mem, size); });
+#else
+  std::ifstream in(path, std::ios::binary);
+  ABORT_IF(!in, "Failed opening file: {}", path);
+  in.seekg(offset);
+  AlignedMemory memory(size, alignment);
+  in.read(memory.begin(), size);
+  ABORT_IF(static_cast<size_t>(in.gcount()) != size, "Error reading {} bytes at offset {} of file: {}", size, offset,
+           path);
+  return memory;
+#endif
+}
+
+bool mapsFilesToMemory(const marian::Ptr<marian::Options>& options) { return options->get<bool>("model-mmap", false); }
+
 AlignedMemory getModelMemoryFromConfig(marian::Ptr<marian::Options> options) {
   auto models = options->get<std::vector<std::string>>("models");
   ABORT_IF(models.size() != 1, "Loading multiple binary models is not supported for now as it is not necessary.");
 
-  // If binary model we load into aligned memory. If .npz we leave it be to
-  // return empty aligned memory, thus allowing traditional file system loads.
+  // A binary model is loaded into aligned memory as is. An .npz model is loaded and laid out in memory as the binary
+  // model it converts to. Either way, replicas of the backend map parameters from this one copy.
   if (marian::io::isBin(models[0])) {
-    AlignedMemory alignedMemory = loadFileToMemory(models[0], 256);
+    if (mapsFilesToMemory(options)) {
+      return mapFileToMemory(models[0], kModelAlignment);
+    }
+    AlignedMemory alignedMemory = loadFileToMemory(models[0], kModelAlignment);
     return alignedMemory;
   } else if (marian::io::isNpz(models[0])) {
-    return AlignedMemory();
+    return binaryModelFromItems(io::loadItems(models[0]));
   } else {
     ABORT("Unknown extension for model: {}, should be one of `.bin` or `.npz`", models[0]);
   }
@@ -113,7 +220,7 @@ AlignedMemory getShortlistMemoryFromConfig(marian::Ptr<marian::Options> options)
   if (!shortlist.empty()) {
     ABORT_IF(!marian::data::isBinaryShortlist(shortlist[0]),
              "Loading non-binary shortlist file into memory is not supported");
-    return loadFileToMemory(shortlist[0], 64);
+    return mapsFilesToMemory(options) ? mapFileToMemory(shortlist[0], 64) : loadFileToMemory(shortlist[0], 64);
   }
   return AlignedMemory();
 }
@@ -129,7 +236,8 @@ void getVocabsMemoryFromConfig(marian::Ptr<marian::Options> options,
              "Loading non-SentencePiece vocab files into memory is not supported");
     auto m = vocabMap.emplace(std::make_pair(vfiles[i], std::shared_ptr<AlignedMemory>()));
     if (m.second) {
-      m.first->second = std::make_shared<AlignedMemory>(loadFileToMemory(vfiles[i], 64));
+      m.first->second = std::make_shared<AlignedMemory>(mapsFilesToMemory(options) ? mapFileToMemory(vfiles[i], 64)
+                                                                                    : loadFileToMemory(vfiles[i], 64));
     }
     vocabMemories[i] = m.first->second;
   }
@@ -151,13 +259,25 @@ AlignedMemory getQualityEstimatorModel(MemoryBundle& memoryBundle, const marian:
   return std::move(memoryBundle.qualityEstimatorMemory);
 }
 
-MemoryBundle getMemoryBundleFromConfig(marian::Ptr<marian::Options> options) {
+MemoryBundle getMemoryBundleFromConfig(marian::Ptr<marian::Options> options, bool concurrently /*=false*/) {
+  // Deferred reads run on the calling thread when their result is asked for, in the order below.
+  std::launch policy = concurrently ? std::launch::async : std::launch::deferred;
+  auto model = std::async(policy, [&options]() { return getModelMemoryFromConfig(options); });
+  auto shortlist = std::async(policy, [&options]() { return getShortlistMemoryFromConfig(options); });
+  auto vocabs = std::async(policy, [&options]() {
+    std::vector<std::shared_ptr<AlignedMemory>> vocabMemories;
+    getVocabsMemoryFromConfig(options, vocabMemories);
+    return vocabMemories;
+  });
+  auto ssplitPrefixFile = std::async(policy, [&options]() { return getSsplitPrefixFileMemoryFromConfig(options); });
+  auto qualityEstimatorMemory = std::async(policy, [&options]() { return getQualityEstimatorModel(options); });
+
   MemoryBundle memoryBundle;
-  memoryBundle.model = getModelMemoryFromConfig(options);
-  memoryBundle.shortlist = getShortlistMemoryFromConfig(options);
-  getVocabsMemoryFromConfig(options, memoryBundle.vocabs);
-  memoryBundle.ssplitPrefixFile = getSsplitPrefixFileMemoryFromConfig(options);
-  memoryBundle.qualityEstimatorMemory = getQualityEstimatorModel(options);
+  memoryBundle.model = model.get();
+  memoryBundle.shortlist = shortlist.get();
+  memoryBundle.vocabs = vocabs.get();
+  memoryBundle.ssplitPrefixFile = ssplitPrefixFile.get();
+  memoryBundle.qualityEstimatorMemory = qualityEstimatorMemory.get();
 
   return memoryBundle;
 }
@@ -1,3 +1,6 @@
+#ifndef SRC_BERGAMOT_BYTE_ARRAY_UTIL_H_
+#define SRC_BERGAMOT_BYTE_ARRAY_UTIL_H_
+
 #include "definitions.h"
 #include "marian.h"
 
@@ -5,6 +8,19 @@ namespace marian {
 namespace bergamot {
 
 AlignedMemory loadFileToMemory(const std::string& path, size_t alignment);
+
+/// Maps the file at path into memory where supported, instead of reading it in as loadFileToMemory(...) does. Pages are
+/// faulted in as they are used, and shared with other processes mapping the same file as long as they are not written
+/// to (copy-on-write), which they are not by anything here. Falls back to loadFileToMemory(...) on platforms without
+/// memory mapping (Windows, WebAssembly).
+AlignedMemory mapFileToMemory(const std::string& path, size_t alignment);
+
+/// Maps size bytes at offset in the file at path into memory, as mapFileToMemory(...) does the whole file. offset is
+/// required to be a multiple of the page size.
+AlignedMemory mapFileToMemory(const std::string& path, size_t alignment, size_t offset, size_t size);
+
+/// Whether files are to be mapped rather than read into memory, on `--model-mmap`.
+bool mapsFilesToMemory(const marian::Ptr<marian::Options>& options);
 AlignedMemory getModelMemoryFromConfig(marian::Ptr<marian::Options> options);
 AlignedMemory getQualityEstimatorModel(const marian::Ptr<marian::Options>& options);
 AlignedMemory getQualityEstimatorModel(MemoryBundle& memoryBundle, const marian::Ptr<marian::Options>& options);
@@ -13,6 +29,11 @@ AlignedMemory getSsplitPrefixFileMemoryFromConfig(marian::Ptr<marian::Options> o
 void getVocabsMemoryFromConfig(marian::Ptr<marian::Options> options,
                                std::vector<std::shared_ptr<AlignedMemory>>& vocabMemories);
 bool validateBinaryModel(const AlignedMemory& model, uint64_t fileSize);
-MemoryBundle getMemoryBundleFromConfig(marian::Ptr<marian::Options> options);
+
+/// Reads the byte-arrays of a MemoryBundle from the paths in options. If concurrently, the files (model, shortlist,
+/// vocabs, ssplit prefix file, quality estimator model) are read on threads of their own, otherwise one after another.
+MemoryBundle getMemoryBundleFromConfig(marian::Ptr<marian::Options> options, bool concurrently = false);
 }  // namespace bergamot
 }  // namespace marian
+
+#endif  // SRC_BERGAMOT_BYTE_ARRAY_UTIL_H_
@@ -0,0 +1,57 @@
+#include "completion_pool.h"
+
+#include "common/logging.h"
+
+namespace marian {
+namespace bergamot {
+
+CompletionPool::CompletionPool(size_t numThreads) {
+  ABORT_IF(numThreads == 0, "Completion pool requires at least 1 thread");
+  threads_.reserve(numThreads);
+  for (size_t i = 0; i < numThreads; i++) {
+    threads_.emplace_back([this]() {
+      while (true) {
+        std::function<void()> task;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          work_.wait(lock, [this]() { return !tasks_.empty() || shutdown_; });
+          if (tasks_.empty()) {
+            return;
+          }
+          task = std::move(tasks_.front());
+          tasks_.pop_front();
+        }
+        task();
+      }
+    });
+  }
+}
+
+CompletionPool::~CompletionPool() { shutdown(); }
+
+void CompletionPool::submit(std::function<void()> &&task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  work_.notify_one();
+}
+
+void CompletionPool::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutdown_) {
+      return;
+    }
+    shutdown_ = true;
+  }
+  work_.notify_all();
+
+  // A thread exits only once there is nothing queued, so everything submitted before (or by tasks during) this runs.
+  for (std::thread &thread : threads_) {
+    thread.join();
+  }
+}
+
+}  // namespace bergamot
+}  // namespace marian
@@ -0,0 +1,52 @@
+#ifndef SRC_BERGAMOT_COMPLETION_POOL_H_
+#define SRC_BERGAMOT_COMPLETION_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "definitions.h"
+
+namespace marian {
+namespace bergamot {
+
+/// Threads completing requests off the translation workers: building the Response from histories (decoding, alignments,
+/// quality scores), restoring HTML, and running client callbacks. A worker hands the completion of a request over and
+/// goes back to translating, instead of leaving its workspace idle meanwhile.
+///
+/// Tasks are run in the order submitted, by whichever thread is free.
+class CompletionPool {
+ public:
+  /// @param [in] numThreads: Number of threads to run tasks on, at least 1.
+  explicit CompletionPool(size_t numThreads);
+
+  /// Runs tasks pending and joins threads, see shutdown().
+  ~CompletionPool();
+
+  /// Queues task to run on one of the threads. Safe to call from any thread, including those of the pool.
+  void submit(std::function<void()> &&task);
+
+  /// Executor submitting to this pool. Valid as long as the pool is.
+  Executor executor() {
+    return [this](std::function<void()> task) { submit(std::move(task)); };
+  }
+
+  /// Runs tasks already queued, including any they submit in turn, then joins threads. Tasks must not be submitted from
+  /// other threads after.
+  void shutdown();
+
+ private:
+  std::vector<std::thread> threads_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable work_;
+  bool shutdown_{false};
+};
+
+}  // namespace bergamot
+}  // namespace marian
+
+#endif  // SRC_BERGAMOT_COMPLETION_POOL_H_
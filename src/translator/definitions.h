@@ -54,6 +54,10 @@ struct SubwordRange {
 
 class Response;
 using CallbackType = std::function<void(Response &&)>;
+using MultipleCallbackType = std::function<void(std::vector<Response> &&)>;
+
+/// Runs a task, typically on a thread of its own choosing.
+using Executor = std::function<void(std::function<void()>)>;
 
 }  // namespace bergamot
 }  // namespace marian
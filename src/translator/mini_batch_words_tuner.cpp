@@ -0,0 +1,75 @@
+#include "mini_batch_words_tuner.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace marian {
+namespace bergamot {
+
+MiniBatchWordsTuner::MiniBatchWordsTuner(size_t initialWords, size_t minWords, size_t maxWords, bool enabled)
+    : value_(std::clamp(initialWords, minWords, maxWords)),
+      converged_(!enabled),
+      minWords_(minWords),
+      maxWords_(maxWords),
+      bestWords_(value_.load()) {}
+
+bool MiniBatchWordsTuner::observe(size_t words, size_t paddedWords, std::chrono::duration<double> elapsed) {
+  if (converged()) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (converged() || paddedWords < kFullBatch * value()) {
+    return false;
+  }
+
+  batches_ += 1;
+  words_ += words;
+  seconds_ += elapsed.count();
+  if (batches_ < kWindow || seconds_ <= 0) {
+    return false;
+  }
+
+  double throughput = words_ / seconds_;
+  batches_ = 0;
+  words_ = 0;
+  seconds_ = 0;
+
+  if (throughput > bestThroughput_) {
+    // Better: keep going the same way.
+    bestThroughput_ = throughput;
+    bestWords_ = value();
+    if (move()) {
+      return false;
+    }
+  }
+
+  // Worse, or out of room to go on: back to the best, and try the other way with a smaller step.
+  while (true) {
+    upwards_ = !upwards_;
+    step_ = std::sqrt(step_);
+    if (step_ < kConvergedStep) {
+      value_.store(bestWords_, std::memory_order_relaxed);
+      converged_.store(true, std::memory_order_relaxed);
+      return true;
+    }
+
+    if (move()) {
+      return false;
+    }
+  }
+}
+
+bool MiniBatchWordsTuner::move() {
+  double factor = upwards_ ? step_ : 1.0 / step_;
+  size_t next = std::clamp(static_cast<size_t>(std::lround(bestWords_ * factor)), minWords_, maxWords_);
+  if (next == bestWords_) {
+    return false;
+  }
+
+  value_.store(next, std::memory_order_relaxed);
+  return true;
+}
+
+}  // namespace bergamot
+}  // namespace marian
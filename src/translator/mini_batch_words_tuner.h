@@ -0,0 +1,66 @@
+#ifndef SRC_BERGAMOT_MINI_BATCH_WORDS_TUNER_H_
+#define SRC_BERGAMOT_MINI_BATCH_WORDS_TUNER_H_
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace marian {
+namespace bergamot {
+
+/// Tunes the budget of words in a batch (`mini-batch-words`) online, to the value giving the best translation
+/// throughput on the hardware and load at hand.
+///
+/// Throughput is measured in source words per second of translation, over a window of batches which were full enough
+/// for the budget to have mattered; under light load batches are small regardless of the budget, and tell nothing
+/// about it. The budget is hill-climbed in multiplicative steps within [minWords, maxWords]: it keeps moving in one
+/// direction as long as throughput improves, otherwise it goes back to the best value seen and tries the other
+/// direction with a smaller step. Once the step is small enough to not matter, the tuner settles on the best value.
+///
+/// When disabled, value() stays at the initial value. Thread-safe, as batches complete on multiple workers.
+class MiniBatchWordsTuner {
+ public:
+  MiniBatchWordsTuner(size_t initialWords, size_t minWords, size_t maxWords, bool enabled);
+
+  /// Budget of words in a batch to use currently.
+  size_t value() const { return value_.load(std::memory_order_relaxed); }
+
+  /// Whether tuning is complete (or disabled), in which case value() no longer changes.
+  bool converged() const { return converged_.load(std::memory_order_relaxed); }
+
+  /// Records a batch of words (paddedWords counting rows times the longest source) translated in elapsed time.
+  ///
+  /// @returns true if this observation completed tuning.
+  bool observe(size_t words, size_t paddedWords, std::chrono::duration<double> elapsed);
+
+ private:
+  static constexpr size_t kWindow = 16;           // Batches in a measurement.
+  static constexpr double kFullBatch = 0.75;      // Fraction of the budget a batch must use to be measured.
+  static constexpr double kInitialStep = 2.0;     // First step, as a factor on the budget.
+  static constexpr double kConvergedStep = 1.05;  // Step below which tuning stops.
+
+  // Moves to a value step away from best in direction, clamped to bounds. Returns false if there is no room to move.
+  bool move();
+
+  std::mutex mutex_;
+  std::atomic<size_t> value_;
+  std::atomic<bool> converged_;
+  size_t minWords_;
+  size_t maxWords_;
+
+  // Measurement in progress, for value_.
+  size_t batches_{0};
+  size_t words_{0};
+  double seconds_{0};
+
+  // Search state.
+  size_t bestWords_;
+  double bestThroughput_{0};
+  double step_{kInitialStep};
+  bool upwards_{true};
+};
+
+}  // namespace bergamot
+}  // namespace marian
+
+#endif  // SRC_BERGAMOT_MINI_BATCH_WORDS_TUNER_H_
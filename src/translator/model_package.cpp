@@ -0,0 +1,277 @@
+#include "model_package.h"
+
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "byte_array_util.h"
+#include "common/logging.h"
+
+namespace marian {
+namespace bergamot {
+
+namespace {
+
+const char kMagic[8] = {'B', 'E', 'R', 'G', 'A', 'M', 'O', 'T'};
+const uint64_t kVersion = 1;
+
+enum SectionKind : uint64_t {
+  kConfig = 0,
+  kModel = 1,
+  kShortlist = 2,
+  kVocab = 3,
+  kSsplitPrefixFile = 4,
+  kQualityEstimator = 5,
+  kNumSectionKinds
+};
+
+struct Header {
+  char magic[8];
+  uint64_t version;
+  uint64_t numSections;
+};
+
+struct Section {
+  uint64_t kind;
+  uint64_t index;  // Position among vocabs, 0 for other kinds.
+  uint64_t offset;
+  uint64_t size;
+  uint64_t checksum;
+};
+
+size_t alignUp(size_t size) {
+  return (size + kModelPackageAlignment - 1) / kModelPackageAlignment * kModelPackageAlignment;
+}
+
+uint64_t checksum(const char *data, size_t size) {
+  const uint64_t kPrime = 0x100000001b3ULL;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, data + i, sizeof(uint64_t));
+    hash = (hash ^ word) * kPrime;
+  }
+  for (; i < size; i++) {
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * kPrime;
+  }
+  return hash;
+}
+
+bool validHeader(const Header &header) {
+  return std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion;
+}
+
+// Checks the section entries of a package of packageSize bytes against the file and each other, logging what is wrong
+// if not: sections are of known kinds and lie within the file, and there are a config, a model and vocabs in each
+// position from 0 up to their number, at least two.
+bool validSections(const std::vector<Section> &sections, size_t packageSize, const std::string &path) {
+  size_t counts[kNumSectionKinds] = {0};
+  for (const Section &section : sections) {
+    if (section.kind >= kNumSectionKinds) {
+      LOG(warn, "Model package {} has a section of unknown kind {}", path, section.kind);
+      return false;
+    }
+    if (section.offset % kModelPackageAlignment != 0 || section.offset > packageSize ||
+        section.size > packageSize - section.offset) {
+      LOG(warn, "Model package {} has a section of kind {} outside the file, incomplete download?", path,
+          section.kind);
+      return false;
+    }
+    counts[section.kind]++;
+  }
+
+  if (counts[kConfig] != 1 || counts[kModel] != 1 || counts[kVocab] < 2) {
+    LOG(warn, "Model package {} needs a config, a model and at least two vocabs", path);
+    return false;
+  }
+
+  std::vector<bool> vocabPositions(counts[kVocab], false);
+  for (const Section &section : sections) {
+    if (section.kind != kVocab) {
+      continue;
+    }
+    if (section.index >= vocabPositions.size() || vocabPositions[section.index]) {
+      LOG(warn, "Model package {} has vocabs in positions other than 0 to {}", path, vocabPositions.size() - 1);
+      return false;
+    }
+    vocabPositions[section.index] = true;
+  }
+  return true;
+}
+
+// Reads header and section entries of the package at path, aborting if it is not a package or the entries do not fit
+// the file (see validSections(...)).
+std::vector<Section> readSections(const std::string &path) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  ABORT_IF(!in, "Failed opening model package: {}", path);
+  size_t packageSize = static_cast<size_t>(in.tellg());
+  in.seekg(0);
+
+  Header header;
+  in.read(reinterpret_cast<char *>(&header), sizeof(Header));
+  ABORT_IF(!in || !validHeader(header), "Not a model package (of version {}): {}", kVersion, path);
+  ABORT_IF(header.numSections > (packageSize - sizeof(Header)) / sizeof(Section),
+           "Model package is truncated within its section entries: {}", path);
+
+  std::vector<Section> sections(header.numSections);
+  in.read(reinterpret_cast<char *>(sections.data()), sections.size() * sizeof(Section));
+  ABORT_IF(!in, "Model package is truncated: {}", path);
+  ABORT_IF(!validSections(sections, packageSize, path), "Model package is invalid: {}", path);
+  return sections;
+}
+
+}  // namespace
+
+void writeModelPackage(const std::string &path, const std::string &config, const MemoryBundle &memory) {
+  // Sections in the order stored, with entries for vocabs in every position they are used in.
+  struct Content {
+    uint64_t kind;
+    uint64_t index;
+    const char *data;
+    size_t size;
+  };
+  std::vector<Content> contents;
+  contents.push_back(Content{kConfig, 0, config.data(), config.size()});
+  contents.push_back(Content{kModel, 0, memory.model.begin(), memory.model.size()});
+  if (memory.shortlist.size() > 0) {
+    contents.push_back(Content{kShortlist, 0, memory.shortlist.begin(), memory.shortlist.size()});
+  }
+  for (size_t i = 0; i < memory.vocabs.size(); i++) {
+    contents.push_back(Content{kVocab, i, memory.vocabs[i]->begin(), memory.vocabs[i]->size()});
+  }
+  if (memory.ssplitPrefixFile.size() > 0) {
+    contents.push_back(
+        Content{kSsplitPrefixFile, 0, memory.ssplitPrefixFile.begin(), memory.ssplitPrefixFile.size()});
+  }
+  if (memory.qualityEstimatorMemory.size() > 0) {
+    contents.push_back(Content{kQualityEstimator, 0, memory.qualityEstimatorMemory.begin(),
+                               memory.qualityEstimatorMemory.size()});
+  }
+
+  std::vector<Section> sections;
+  std::vector<const Content *> stored;
+  std::unordered_map<const char *, size_t> offsets;  // By data, so that shared vocabs are stored once.
+  size_t offset = alignUp(sizeof(Header) + contents.size() * sizeof(Section));
+  for (const Content &content : contents) {
+    auto found = offsets.find(content.data);
+    if (found == offsets.end()) {
+      found = offsets.emplace(content.data, offset).first;
+      stored.push_back(&content);
+      offset = alignUp(offset + content.size);
+    }
+    sections.push_back(Section{content.kind, content.index, found->second, content.size,
+                               checksum(content.data, content.size)});
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  ABORT_IF(!out, "Failed opening {} to write model package to", path);
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.numSections = sections.size();
+  out.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+  out.write(reinterpret_cast<const char *>(sections.data()), sections.size() * sizeof(Section));
+
+  // Sections are written in order of offset, padding with zeros up to each.
+  for (const Content *content : stored) {
+    size_t position = static_cast<size_t>(out.tellp());
+    std::vector<char> padding(offsets[content->data] - position, 0);
+    out.write(padding.data(), padding.size());
+    out.write(content->data, content->size);
+  }
+  ABORT_IF(!out, "Failed writing model package to {}", path);
+}
+
+MemoryBundle loadModelPackage(const std::string &path, std::string &config, bool validate /*=false*/) {
+  ABORT_IF(validate && !validateModelPackage(path), "Model package is invalid: {}", path);
+
+  MemoryBundle memory;
+  std::map<uint64_t, std::shared_ptr<AlignedMemory>> vocabsByOffset;
+  for (const Section &section : readSections(path)) {
+    switch (section.kind) {
+      case kConfig: {
+        AlignedMemory bytes = mapFileToMemory(path, 64, section.offset, section.size);
+        config.assign(bytes.begin(), bytes.size());
+        break;
+      }
+      case kModel:
+        memory.model = mapFileToMemory(path, 256, section.offset, section.size);
+        break;
+      case kShortlist:
+        memory.shortlist = mapFileToMemory(path, 64, section.offset, section.size);
+        break;
+      case kVocab: {
+        std::shared_ptr<AlignedMemory> &vocab = vocabsByOffset[section.offset];
+        if (!vocab) {
+          vocab = std::make_shared<AlignedMemory>(mapFileToMemory(path, 64, section.offset, section.size));
+        }
+        if (memory.vocabs.size() <= section.index) {
+          memory.vocabs.resize(section.index + 1);
+        }
+        memory.vocabs[section.index] = vocab;
+        break;
+      }
+      case kSsplitPrefixFile:
+        memory.ssplitPrefixFile = mapFileToMemory(path, 64, section.offset, section.size);
+        break;
+      case kQualityEstimator:
+        memory.qualityEstimatorMemory = mapFileToMemory(path, 64, section.offset, section.size);
+        break;
+      default:
+        ABORT("Unknown section kind {} in model package: {}", section.kind, path);
+    }
+  }
+
+  return memory;
+}
+
+bool validateModelPackage(const std::string &path) {
+  AlignedMemory package = mapFileToMemory(path, 64);
+  size_t packageSize = package.size();
+
+  Header header;
+  if (packageSize < sizeof(Header)) {
+    LOG(warn, "Model package {} is too small to hold a header", path);
+    return false;
+  }
+  std::memcpy(&header, package.begin(), sizeof(Header));
+  if (!validHeader(header)) {
+    LOG(warn, "{} is not a model package of version {}", path, kVersion);
+    return false;
+  }
+  if (header.numSections > (packageSize - sizeof(Header)) / sizeof(Section)) {
+    LOG(warn, "Model package {} is truncated within its section entries", path);
+    return false;
+  }
+
+  std::vector<Section> sections(header.numSections);
+  std::memcpy(sections.data(), package.begin() + sizeof(Header), sections.size() * sizeof(Section));
+
+  if (!validSections(sections, packageSize, path)) {
+    return false;
+  }
+
+  for (const Section &section : sections) {
+    const char *data = package.begin() + section.offset;
+    if (checksum(data, section.size) != section.checksum) {
+      LOG(warn, "Model package {} has a section of kind {} not matching its checksum, corrupted?", path, section.kind);
+      return false;
+    }
+    if (section.kind == kModel) {
+      // A view on the section, not freeing it.
+      AlignedMemory model(const_cast<char *>(data), section.size, [](char *, size_t) {});
+      if (!validateBinaryModel(model, model.size())) {
+        LOG(warn, "Model package {} holds an invalid model", path);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace bergamot
+}  // namespace marian
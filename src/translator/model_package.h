@@ -0,0 +1,43 @@
+#ifndef SRC_BERGAMOT_MODEL_PACKAGE_H_
+#define SRC_BERGAMOT_MODEL_PACKAGE_H_
+
+#include <string>
+
+#include "definitions.h"
+
+namespace marian {
+namespace bergamot {
+
+/// A model package holds everything a TranslationModel is constructed from in a single file: the configuration (YAML)
+/// and the byte-arrays of a MemoryBundle (model, shortlist, vocabs, ssplit prefix file, quality estimator model).
+///
+/// The package consists of a header (magic, version, number of sections), followed by an entry for each section (kind,
+/// position among vocabs, offset, size, checksum) and then the sections themselves. Integers are uint64_t in native
+/// byte order. Each section starts at a multiple of kModelPackageAlignment, so that it can be mapped into memory on its
+/// own, aligned for any use. A vocab used in more than one position is stored once, with entries sharing the offset.
+///
+/// Checksums are FNV-1a over 64-bit words of a section, with the bytes of a trailing partial word taken one at a time.
+
+/// Alignment of sections in a package, a multiple of any page size a package is expected to be mapped with.
+const size_t kModelPackageAlignment = 65536;
+
+/// Writes config and the byte-arrays in memory as a package to path.
+void writeModelPackage(const std::string &path, const std::string &config, const MemoryBundle &memory);
+
+/// Loads the package at path, mapping each section into memory (see mapFileToMemory(...)) instead of reading it in.
+/// The configuration is written to config; a TranslationModel is constructed from config and the MemoryBundle
+/// returned. Aborts if the header and entries are inconsistent or sections lie outside the file.
+///
+/// @param [in] validate: Whether to check the package with validateModelPackage(...) first, which reads it in full to
+/// also match sections against their checksums.
+MemoryBundle loadModelPackage(const std::string &path, std::string &config, bool validate = false);
+
+/// Checks that the package at path is complete and uncorrupted: the header and entries are consistent, sections lie
+/// within the file and match their checksums, and the model passes validateBinaryModel(...). Logs what is wrong if
+/// not.
+bool validateModelPackage(const std::string &path);
+
+}  // namespace bergamot
+}  // namespace marian
+
+#endif  // SRC_BERGAMOT_MODEL_PACKAGE_H_
@@ -0,0 +1,185 @@
+#include "model_registry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <unordered_set>
+
+#include "common/filesystem.h"
+#include "common/logging.h"
+#include "parser.h"
+
+namespace marian {
+namespace bergamot {
+
+namespace {
+
+// Bytes of the files read into memory for a model (see getMemoryBundleFromConfig(...)), which is what it holds once
+// loaded as far as TranslationModel::residentBytes() is concerned.
+size_t estimateBytes(const Ptr<Options> &options) {
+  std::unordered_set<std::string> paths;
+  for (const char *key : {"models", "vocabs", "shortlist"}) {
+    std::vector<std::string> values = options->get<std::vector<std::string>>(key, {});
+    // Only the first of shortlist is a path, the rest are parameters.
+    size_t count = std::string(key) == "shortlist" ? std::min<size_t>(values.size(), 1) : values.size();
+    paths.insert(values.begin(), values.begin() + count);
+  }
+  for (const char *key : {"ssplit-prefix-file", "quality"}) {
+    std::string path = options->get<std::string>(key, "");
+    if (!path.empty()) {
+      paths.insert(path);
+    }
+  }
+
+  size_t bytes = 0;
+  for (const std::string &path : paths) {
+    bytes += filesystem::fileSize(path);
+  }
+  return bytes;
+}
+
+}  // namespace
+
+ModelRegistry::ModelRegistry(const Config &config) : config_(config), state_(std::make_shared<State>()) {}
+
+void ModelRegistry::add(const std::string &name, const std::string &configPath) {
+  Ptr<Options> options = parseOptionsFromFilePath(configPath);
+  auto loader = [name, configPath, options]() {
+    LOG(info, "Loading model {} from {}", name, configPath);
+    return TranslationModel::loadAsync(options).get();
+  };
+  add(name, loader, estimateBytes(options));
+}
+
+void ModelRegistry::add(const std::string &name, Loader loader, size_t estimatedBytes) {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  ABORT_IF(entries_.count(name) > 0, "A model is already registered as {}", name);
+  Entry &entry = entries_[name];
+  entry.loader = std::move(loader);
+  entry.lastBytes = estimatedBytes;
+}
+
+std::shared_ptr<TranslationModel> ModelRegistry::get(const std::string &name) {
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  auto itr = entries_.find(name);
+  ABORT_IF(itr == entries_.end(), "No model registered as {}", name);
+
+  // Entries are never erased, so entry stays valid with the lock released.
+  Entry &entry = itr->second;
+  if (entry.model) {
+    lru_.splice(lru_.begin(), lru_, entry.lru);
+    return entry.model;
+  }
+
+  if (entry.loading.valid()) {
+    std::shared_future<std::shared_ptr<TranslationModel>> loading = entry.loading;
+    lock.unlock();
+    return loading.get();
+  }
+
+  std::promise<std::shared_ptr<TranslationModel>> promise;
+  entry.loading = promise.get_future().share();
+  size_t reserved = 0;
+  try {
+    // Room is made ahead of loading, for as much as the model held when last loaded, or as estimated. Once loaded,
+    // room is made for any difference.
+    makeRoom(lock, entry.lastBytes);
+    reserved = entry.lastBytes;
+    loadingBytes_ += reserved;
+    Loader loader = entry.loader;
+    lock.unlock();
+
+    auto unloadedBytes = std::make_shared<size_t>(0);
+    std::shared_ptr<State> state = state_;
+    std::unique_ptr<TranslationModel> loaded = loader();
+    std::shared_ptr<TranslationModel> model(loaded.release(), [state, unloadedBytes](TranslationModel *model) {
+      delete model;
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->drainingBytes -= *unloadedBytes;
+      state->freed.notify_all();
+    });
+    size_t bytes = model->residentBytes();
+
+    lock.lock();
+    loadingBytes_ -= reserved;
+    reserved = 0;
+    makeRoom(lock, bytes);
+    entry.model = model;
+    entry.unloadedBytes = unloadedBytes;
+    entry.lastBytes = bytes;
+    lru_.push_front(name);
+    entry.lru = lru_.begin();
+    entry.loading = {};
+    lock.unlock();
+
+    promise.set_value(model);
+    return model;
+  } catch (...) {
+    if (!lock.owns_lock()) {
+      lock.lock();
+    }
+    loadingBytes_ -= reserved;
+    entry.loading = {};
+    lock.unlock();
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+}
+
+bool ModelRegistry::loaded(const std::string &name) {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  auto itr = entries_.find(name);
+  return itr != entries_.end() && itr->second.model != nullptr;
+}
+
+size_t ModelRegistry::residentBytes() {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return usedBytes();
+}
+
+void ModelRegistry::makeRoom(std::unique_lock<std::mutex> &lock, size_t bytes) {
+  if (config_.memoryBudgetInMB == 0) {
+    return;
+  }
+
+  size_t budget = config_.memoryBudgetInMB * 1024 * 1024;
+  auto fits = [this, bytes, budget]() { return usedBytes() + bytes <= budget; };
+
+  // One at a time, as a model unloaded may be freed right away, in which case it makes room for sure.
+  while (!fits() && !lru_.empty()) {
+    Entry &entry = entries_[lru_.back()];
+    size_t entryBytes = entry.model->residentBytes();
+    LOG(info, "Unloading model {} of {} MB to stay within budget", lru_.back(), entryBytes / (1024 * 1024));
+    *entry.unloadedBytes = entryBytes;
+    state_->drainingBytes += entryBytes;
+    entry.lastBytes = entryBytes;
+    std::shared_ptr<TranslationModel> unloaded = std::move(entry.model);
+    entry.model = nullptr;
+    lru_.pop_back();
+
+    // Letting go of the last reference to a model frees it, which takes the lock.
+    lock.unlock();
+    unloaded = nullptr;
+    lock.lock();
+  }
+
+  auto drained = [this, &fits]() { return fits() || state_->drainingBytes == 0; };
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(config_.drainTimeoutInMilliseconds);
+  if (!state_->freed.wait_until(lock, deadline, drained) || !fits()) {
+    LOG(warn, "Going over the memory budget of {} MB to {} MB, of which {} MB by models unloaded but still in use",
+        config_.memoryBudgetInMB, (usedBytes() + bytes) / (1024 * 1024), state_->drainingBytes / (1024 * 1024));
+  }
+}
+
+size_t ModelRegistry::loadedBytes() {
+  size_t bytes = 0;
+  for (const std::string &name : lru_) {
+    bytes += entries_[name].model->residentBytes();
+  }
+  return bytes;
+}
+
+size_t ModelRegistry::usedBytes() { return loadedBytes() + state_->drainingBytes + loadingBytes_; }
+
+}  // namespace bergamot
+}  // namespace marian
@@ -0,0 +1,118 @@
+#ifndef SRC_BERGAMOT_MODEL_REGISTRY_H_
+#define SRC_BERGAMOT_MODEL_REGISTRY_H_
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "translation_model.h"
+
+namespace marian {
+namespace bergamot {
+
+/// Holds TranslationModels for more language pairs than fit in memory at once: models are loaded from their
+/// configuration on first use, and the least recently used are unloaded to stay within a memory budget.
+///
+/// Memory of a model is as reported by TranslationModel::residentBytes(). A model is unloaded by the registry letting
+/// go of it, and freed once everyone else has too. Services hold on to a model while it has requests pending or batches
+/// in translation, so that requests in flight drain first. Until freed, a model still counts against the budget, and
+/// loading another waits for it up to a timeout.
+///
+/// Thread-safe. A model asked for by several threads at once is loaded once, and loading a model does not hold up
+/// threads asking for models already loaded.
+class ModelRegistry {
+ public:
+  struct Config {
+    /// Memory budget for models, 0 for unlimited.
+    size_t memoryBudgetInMB{0};
+
+    /// Time to wait for models unloaded to be freed, when loading a model needs the room. The model is loaded anyway
+    /// (over budget) after.
+    size_t drainTimeoutInMilliseconds{10000};
+
+    template <class App>
+    static void addOptions(App &app, Config &config) {
+      app.add_option("--model-memory-budget", config.memoryBudgetInMB, "Memory for models in MB, 0 for unlimited");
+      app.add_option("--model-drain-timeout", config.drainTimeoutInMilliseconds,
+                     "Milliseconds to wait on models unloaded to be freed, before loading over budget");
+    }
+  };
+
+  /// Loads a model, on the thread asking for it, without the registry locked.
+  using Loader = std::function<std::unique_ptr<TranslationModel>()>;
+
+  ModelRegistry(const Config &config);
+
+  /// Registers a model under name, to be loaded from the model configuration at configPath when first asked for. Room
+  /// is made for the model ahead of loading it first from the size of the files it loads.
+  void add(const std::string &name, const std::string &configPath);
+
+  /// Registers a model under name, to be loaded by loader when first asked for. Room is made for estimatedBytes ahead
+  /// of loading it first, and for the bytes it was found to hold ahead of loading it again.
+  void add(const std::string &name, Loader loader, size_t estimatedBytes);
+
+  /// The model registered under name, loaded if it is not, unloading least recently used models as needed to stay
+  /// within budget. Blocks while the model is loaded, and on models unloaded to be freed.
+  std::shared_ptr<TranslationModel> get(const std::string &name);
+
+  /// Whether the model registered under name is loaded.
+  bool loaded(const std::string &name);
+
+  /// Bytes held by models loaded, by models unloaded but not freed yet, and set aside for models being loaded.
+  size_t residentBytes();
+
+ private:
+  /// State shared with models loaded, which account for being freed when they are, possibly after the registry is gone.
+  struct State {
+    std::mutex mutex;
+    std::condition_variable freed;
+    size_t drainingBytes{0};  ///< Bytes of models unloaded but not freed yet.
+  };
+
+  struct Entry {
+    Loader loader;
+    std::shared_ptr<TranslationModel> model;  ///< Null unless loaded.
+    std::list<std::string>::iterator lru;     ///< Position in lru_, if loaded.
+
+    /// Valid while the model is being loaded, for others asking for it to wait on.
+    std::shared_future<std::shared_ptr<TranslationModel>> loading;
+
+    /// Bytes of the model as last unloaded, counted in State::drainingBytes until freed. Shared with the model.
+    std::shared_ptr<size_t> unloadedBytes;
+
+    /// Bytes as last loaded, or as estimated if never loaded, to make room for ahead of loading.
+    size_t lastBytes{0};
+  };
+
+  /// Unloads least recently used models until bytes more fit in the budget, and waits for them to be freed. Called
+  /// with lock held, which is released in between.
+  void makeRoom(std::unique_lock<std::mutex> &lock, size_t bytes);
+
+  /// Bytes of models loaded. Requires the lock to be held.
+  size_t loadedBytes();
+
+  /// Bytes counted against the budget: of models loaded, unloaded but not freed, and being loaded. Requires the lock to
+  /// be held.
+  size_t usedBytes();
+
+  Config config_;
+  std::shared_ptr<State> state_;
+
+  /// Models by name, and names of models loaded from most to least recently used. Guarded by state_->mutex.
+  std::unordered_map<std::string, Entry> entries_;
+  std::list<std::string> lru_;
+
+  /// Room made for models being loaded, so that loading several at once does not go over budget. Guarded by
+  /// state_->mutex.
+  size_t loadingBytes_{0};
+};
+
+}  // namespace bergamot
+}  // namespace marian
+
+#endif  // SRC_BERGAMOT_MODEL_REGISTRY_H_
@@ -29,6 +29,27 @@ std::shared_ptr<marian::Options> parseOptionsFromString(const std::string &confi
   configParser.addOption<size_t>("--max-length-break", "Bergamot Options",
                                  "Maximum input tokens to be processed in a single sentence.", 128);
 
+  configParser.addOption<float>("--max-batch-length-ratio", "Bergamot Options",
+                                "Maximum ratio of longest to shortest translation predicted in a batch, 0 for none.",
+                                0.0f);
+
+  configParser.addOption<size_t>("--max-batches-passed-over", "Bergamot Options",
+                                 "Maximum batches formed while a sentence waits, before it goes into the next one "
+                                 "regardless of priority, 0 for no limit.",
+                                 16);
+
+  configParser.addOption<bool>("--budget-target-words", "Bergamot Options",
+                               "Count predicted target words against mini-batch-words, besides source words.", false);
+
+  configParser.addOption<bool>("--autotune-mini-batch-words", "Bergamot Options",
+                               "Tune mini-batch-words online for throughput, within min/max-mini-batch-words.", false);
+
+  configParser.addOption<size_t>("--min-mini-batch-words", "Bergamot Options",
+                                 "Lower bound when auto-tuning mini-batch-words, 0 for a default.", 0);
+
+  configParser.addOption<size_t>("--max-mini-batch-words", "Bergamot Options",
+                                 "Upper bound when auto-tuning mini-batch-words, 0 for a default.", 0);
+
   // The following is a complete hijack of an existing option, so no need to add explicitly.
   // configParser.addOption<size_t>("--mini-batch-words", "Bergamot Options",
   //                                "Maximum input tokens to be processed in a single sentence.", 1024);
@@ -41,6 +62,12 @@ std::shared_ptr<marian::Options> parseOptionsFromString(const std::string &confi
 
   configParser.addOption<std::string>("--quality", "Bergamot Options", "File considering Quality Estimation model");
 
+  configParser.addOption<float>("--scheduling-weight", "Bergamot Options",
+                                "Share of workers for this model relative to other models served together.", 1.0f);
+
+  configParser.addOption<size_t>("--max-active-batches", "Bergamot Options",
+                                 "Maximum batches of this model translated concurrently, 0 for no limit.", 0);
+
   // Parse configs onto defaultConfig. The preliminary merge sets the YAML internal representation with legal values.
   const YAML::Node &defaultConfig = configParser.getConfig();
   options.merge(defaultConfig);
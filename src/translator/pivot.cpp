@@ -0,0 +1,132 @@
+#include "pivot.h"
+
+#include <string>
+#include <vector>
+
+namespace marian {
+namespace bergamot {
+
+namespace {
+
+// Appends the only sentence in part to text, after gap.
+void appendSentence(AnnotatedText &text, string_view gap, const AnnotatedText &part) {
+  std::string prefix(gap.data(), gap.size());
+  string_view partGap = part.gap(0);
+  prefix.append(partGap.data(), partGap.size());
+
+  std::vector<string_view> words;
+  for (size_t wordIdx = 0; wordIdx < part.numWords(0); wordIdx++) {
+    words.push_back(part.word(0, wordIdx));
+  }
+  text.appendSentence(prefix, words.begin(), words.end());
+  text.appendEndingWhitespace(part.gap(1));
+}
+
+}  // namespace
+
+Response combine(Response &&first, Response &&second) {
+  Response combined;
+
+  // Compute alignment first using internal matrices and mappings. An incomplete second leg has none.
+  if (first.alignments.size() && second.status == Response::SUCCESS) {
+    combined.alignments = remapAlignments(first, second);
+  }
+
+  combined.source = std::move(first.source);
+  combined.target = std::move(second.target);
+  combined.qualityScores = std::move(second.qualityScores);
+  combined.status = second.status;
+
+  return combined;
+}
+
+void PivotJoin::issue() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++issued_;
+}
+
+void PivotJoin::completeFirst(Response &&sourceToPivot) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  sourceToPivot_ = std::move(sourceToPivot);
+  tryJoin(lock);
+}
+
+void PivotJoin::completeSentence(size_t sentenceIdx, Response &&pivotToTarget) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  pivotToTargets_.emplace(sentenceIdx, std::move(pivotToTarget));
+  tryJoin(lock);
+}
+
+void PivotJoin::tryJoin(std::unique_lock<std::mutex> &lock) {
+  if (!sourceToPivot_ || pivotToTargets_.size() < issued_) {
+    return;
+  }
+
+  Response sourceToPivot = std::move(*sourceToPivot_);
+  sourceToPivot_.reset();
+  lock.unlock();
+
+  if (sourceToPivot.status != Response::SUCCESS) {
+    // Not every sentence made it to the second leg. Whatever is in target is in the pivot language, which is of no use
+    // to the client. As with an incomplete translation without pivoting, there is a sentence in target for each in
+    // source: translated if it made it through both legs, empty otherwise.
+    Response response;
+    response.source = std::move(sourceToPivot.source);
+    response.status = sourceToPivot.status;
+    size_t numSentences = response.source.numSentences();
+    for (size_t sentenceIdx = 0; sentenceIdx < numSentences; sentenceIdx++) {
+      std::vector<string_view> words;
+      auto translated = pivotToTargets_.find(sentenceIdx);
+      if (translated != pivotToTargets_.end() && translated->second.status == Response::SUCCESS) {
+        const AnnotatedText &target = translated->second.target;
+        for (size_t wordIdx = 0; wordIdx < target.numWords(0); wordIdx++) {
+          words.push_back(target.word(0, wordIdx));
+        }
+      }
+      response.target.appendSentence(response.source.gap(sentenceIdx), words.begin(), words.end());
+    }
+    if (numSentences > 0) {
+      response.target.appendEndingWhitespace(response.source.gap(numSentences));
+    }
+    callback_(std::move(response));
+    return;
+  }
+
+  Response pivotToTarget = stitch(sourceToPivot);
+  Response finalResponse = combine(std::move(sourceToPivot), std::move(pivotToTarget));
+  if (finalResponse.status == Response::SUCCESS) {
+    html_->restore(finalResponse);
+  }
+  callback_(std::move(finalResponse));
+}
+
+Response PivotJoin::stitch(const Response &sourceToPivot) {
+  Response pivotToTarget;
+  size_t numSentences = sourceToPivot.target.numSentences();
+  for (size_t sentenceIdx = 0; sentenceIdx < numSentences; sentenceIdx++) {
+    Response &sentence = pivotToTargets_.at(sentenceIdx);
+    if (sentence.status != Response::SUCCESS) {
+      pivotToTarget.status = sentence.status;
+    }
+
+    string_view gap = sourceToPivot.target.gap(sentenceIdx);
+    appendSentence(pivotToTarget.source, gap, sentence.source);
+    appendSentence(pivotToTarget.target, gap, sentence.target);
+    for (auto &alignment : sentence.alignments) {
+      pivotToTarget.alignments.push_back(std::move(alignment));
+    }
+    for (auto &qualityScore : sentence.qualityScores) {
+      pivotToTarget.qualityScores.push_back(std::move(qualityScore));
+    }
+  }
+
+  if (numSentences > 0) {
+    string_view ending = sourceToPivot.target.gap(numSentences);
+    pivotToTarget.source.appendEndingWhitespace(ending);
+    pivotToTarget.target.appendEndingWhitespace(ending);
+  }
+  return pivotToTarget;
+}
+
+}  // namespace bergamot
+}  // namespace marian
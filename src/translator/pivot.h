@@ -0,0 +1,69 @@
+#ifndef SRC_BERGAMOT_PIVOT_H_
+#define SRC_BERGAMOT_PIVOT_H_
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+
+#include "definitions.h"
+#include "html.h"
+#include "response.h"
+
+namespace marian {
+namespace bergamot {
+
+/// Combines two responses with first.target == second.source mapping alignments etc accordingly. There are several
+/// constraints which are matched by only the pivoting workflow in <>Service source, therefore this function is not for
+/// external use.
+Response combine(Response &&first, Response &&second);
+
+/// Joins the legs of a pivot translation pipelined at sentence level, see AsyncService::pivot(...): the first leg from
+/// source to pivot, and one request to the second model for each sentence of the pivot. The client callback is
+/// triggered with the combined Response once the first leg and every sentence issued to the second leg are complete.
+///
+/// Internal to AsyncService.
+class PivotJoin {
+ public:
+  /// @param [in] callback: Client callback, to be issued with the combined Response.
+  /// @param [in] html: Markup of the source, restored on the combined Response.
+  /// @param [in] done: Called once the join is destroyed, which is once every request of both legs is, whether it
+  /// completed or was cleared without completing.
+  PivotJoin(CallbackType callback, Ptr<HTML> html, std::function<void()> done = nullptr)
+      : callback_(std::move(callback)), html_(std::move(html)), done_(std::move(done)) {}
+
+  ~PivotJoin() {
+    if (done_) {
+      done_();
+    }
+  }
+
+  /// Accounts for a pivot sentence about to be issued to the second leg. Only before the first leg completes.
+  void issue();
+
+  void completeFirst(Response &&sourceToPivot);
+
+  void completeSentence(size_t sentenceIdx, Response &&pivotToTarget);
+
+ private:
+  // Completes the translation if everything is in. Releases lock before triggering the client callback.
+  void tryJoin(std::unique_lock<std::mutex> &lock);
+
+  // Assembles the Responses of the sentences issued to the second leg into one, as if the pivot had been translated in
+  // a single request. Gaps between sentences are those of the pivot.
+  Response stitch(const Response &sourceToPivot);
+
+  CallbackType callback_;
+  Ptr<HTML> html_;
+  std::function<void()> done_;
+
+  std::mutex mutex_;
+  std::optional<Response> sourceToPivot_;
+  std::map<size_t, Response> pivotToTargets_;  // By index of the sentence.
+  size_t issued_{0};
+};
+
+}  // namespace bergamot
+}  // namespace marian
+
+#endif  // SRC_BERGAMOT_PIVOT_H_
@@ -1,5 +1,6 @@
 #include "request.h"
 
+#include <algorithm>
 #include <string>
 
 #include "annotation.h"
@@ -22,51 +23,57 @@ size_t hashForCache(const TranslationModel &model, const marian::Words &words) {
 }
 
 // -----------------------------------------------------------------
-Request::Request(size_t Id, const TranslationModel &model, Segments &&segments, ResponseBuilder &&responseBuilder,
-                 std::optional<TranslationCache> &cache)
+Request::Request(size_t Id, Ptr<const TranslationModel> model, Segments &&segments, ResponseBuilder &&responseBuilder,
+                 const ResponseOptions &responseOptions, std::optional<TranslationCache> &cache,
+                 const RequestHandle &handle, const Executor &completer)
     : Id_(Id),
-      model_(model),
+      priority_(responseOptions.priority),
+      deadline_(responseOptions.deadline),
+      arrival_(std::chrono::steady_clock::now()),
+      model_(std::move(model)),
       segments_(std::move(segments)),
       responseBuilder_(std::move(responseBuilder)),
-      cache_(cache) {
+      cache_(cache),
+      handle_(handle),
+      completer_(completer) {
   counter_ = segments_.size();
   histories_.resize(segments_.size(), nullptr);
 
-  // 1. If there are no segments_, we are never able to trigger the responseBuilder calls from a different thread. This
-  // happens when the use provides empty input, or the sentence and subword preprocessing deems no translatable units
-  // present. However, in this case we want an empty valid response. There's no need to do any additional processing
-  // here.
-  if (segments_.size() == 0) {
-    responseBuilder_(std::move(histories_));
-  } else {
-    counter_ = segments_.size();
-    histories_.resize(segments_.size());
-
-    if (cache_) {
-      // Iterate through segments, see if any can be prefilled from cache. If prefilled, mark the particular segments as
-      // complete (non-empty ProcessedRequestSentence). Also update accounting used elsewhere (counter_) to reflect one
-      // less segment to translate.
-      for (size_t idx = 0; idx < segments_.size(); idx++) {
-        size_t key = hashForCache(model_, getSegment(idx));
-        auto [found, history] = cache_->find(key);
-        if (found) {
-          histories_[idx] = history;
-          --counter_;
-        }
-      }
-      // 2. Also, if cache somehow manages to decrease all counter prefilling histories, then we'd have to trigger
-      // ResponseBuilder as well. No segments go into batching and therefore no processHistory triggers.
-      if (counter_.load() == 0) {
-        responseBuilder_(std::move(histories_));
+  if (cache_) {
+    // Iterate through segments, see if any can be prefilled from cache. If prefilled, mark the particular segments as
+    // complete (non-empty ProcessedRequestSentence). Also update accounting used elsewhere (counter_) to reflect one
+    // less segment to translate. Nothing is issued to the client yet, see completePrefilled().
+    for (size_t idx = 0; idx < segments_.size(); idx++) {
+      size_t key = hashForCache(*model_, getSegment(idx));
+      auto [found, history] = cache_->find(key);
+      if (found) {
+        histories_[idx] = history;
+        --counter_;
       }
     }
   }
 }
 
+void Request::completePrefilled() {
+  for (size_t idx = 0; idx < histories_.size(); idx++) {
+    if (histories_[idx]) {
+      responseBuilder_.streamSentence(idx, *histories_[idx]);
+    }
+  }
+
+  // With no segments_ (empty input, or no translatable units found in preprocessing), or all of them prefilled from
+  // cache, nothing goes into batching and therefore no processHistory triggers the Response.
+  if (counter_.load() == 0) {
+    complete(Response::SUCCESS);
+  }
+}
+
 size_t Request::numSegments() const { return segments_.size(); }
 
 size_t Request::segmentTokens(size_t index) const { return (segments_[index].size()); }
 
+size_t Request::segmentBytes(size_t index) const { return responseBuilder_.source().sentenceAsByteRange(index).size(); }
+
 Segment Request::getSegment(size_t index) const { return segments_[index]; }
 
 void Request::processHistory(size_t index, Ptr<History> history) {
@@ -74,22 +81,60 @@ void Request::processHistory(size_t index, Ptr<History> history) {
   // ready. The container storing histories is set with the value obtained.
 
   // Fill in placeholder from History obtained by freshly translating. Since this was a cache-miss to have got through,
-  // update cache if available to store the result.
+  // update cache if available to store the result. A segment dropped on cancellation has nothing to store.
   histories_[index] = history;
-  if (cache_) {
-    size_t key = hashForCache(model_, getSegment(index));
+  if (cache_ && history) {
+    size_t key = hashForCache(*model_, getSegment(index));
     cache_->store(key, histories_[index]);
   }
 
+  // Streaming happens before accounting for the segment, so that it is done by the time the Response is built.
+  if (history) {
+    std::lock_guard<std::mutex> lock(streamMutex_);
+    responseBuilder_.streamSentence(index, *history);
+  }
+
   // In case this is last request in, completeRequest is called, which sets the
   // value of the promise.
   if (--counter_ == 0) {
-    responseBuilder_(std::move(histories_));
+    auto translated = [](const Ptr<History> &history) { return history != nullptr; };
+    bool allTranslated = std::all_of(histories_.begin(), histories_.end(), translated);
+    Response::Status status = Response::SUCCESS;
+    if (!allTranslated) {
+      status = cancelled() ? Response::CANCELLED : Response::TIMED_OUT;
+    }
+    complete(status);
+  }
+}
+
+void Request::complete(Response::Status status) {
+  if (!completer_) {
+    responseBuilder_(std::move(histories_), status);
+    return;
   }
+
+  // The task holds on to the Request, which the worker is about to let go of, and through it the model owning the
+  // vocabularies and quality estimator used to build the Response.
+  completer_([self = shared_from_this(), status]() { self->responseBuilder_(std::move(self->histories_), status); });
+}
+
+void Request::abandon(Response::Status status) {
+  assert(counter_.load() > 0);
+  counter_ = 0;
+  responseBuilder_(std::move(histories_), status);
 }
 
 bool Request::operator<(const Request &b) const {
-  // Among Requests, only sequence id is used for obtaining priority.
+  // Higher priority is more urgent, hence compares less.
+  if (priority_ != b.priority_) {
+    return priority_ > b.priority_;
+  }
+
+  if (deadline_ != b.deadline_) {
+    return deadline_ < b.deadline_;
+  }
+
+  // Sequence id breaks ties, which makes for first-come first-serve among otherwise equal Requests.
   return Id_ < b.Id_;
 }
 
@@ -99,6 +144,8 @@ RequestSentence::RequestSentence(size_t index, Ptr<Request> request) : index_(in
 
 size_t RequestSentence::numTokens() const { return (request_->segmentTokens(index_)); }
 
+size_t RequestSentence::numBytes() const { return (request_->segmentBytes(index_)); }
+
 void RequestSentence::completeSentence(Ptr<History> history) {
   // Relays completeSentence into request's processHistory, using index
   // information.
@@ -112,7 +159,7 @@ bool operator<(const RequestSentence &a, const RequestSentence &b) {
   if (a.request_ == b.request_) {
     return a.index_ < b.index_;
   }
-  return a.request_ < b.request_;
+  return *a.request_ < *b.request_;
 }
 
 // ----------------------------------------------------------------------
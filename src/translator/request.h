@@ -1,8 +1,11 @@
 #ifndef SRC_BERGAMOT_REQUEST_H_
 #define SRC_BERGAMOT_REQUEST_H_
 
+#include <atomic>
 #include <cassert>
 #include <future>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include "annotation.h"
@@ -19,6 +22,59 @@ namespace bergamot {
 
 class TranslationModel;
 
+/// Handle to a translation submitted to AsyncService, through which the client can cancel it. Copies of a handle refer
+/// to the same translation. Sentences of a cancelled translation still pending are dropped from the batching pools
+/// instead of being translated, as soon as the pools are next looked at (a batch formed, a request admitted), wherever
+/// the sentences are queued. From then on they no longer count as pending. The callback is issued with a Response
+/// marked `Response::CANCELLED` once the sentences already in translation complete. Cancelling a translation that has
+/// completed has no effect.
+class RequestHandle {
+ public:
+  RequestHandle() : state_(std::make_shared<State>()) {}
+
+  /// Requests cancellation. Safe to call from any thread, any number of times.
+  void cancel() {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->cancelled.store(true, std::memory_order_relaxed);
+    for (std::weak_ptr<std::atomic<size_t>> &watcher : state_->watchers) {
+      if (std::shared_ptr<std::atomic<size_t>> cancellations = watcher.lock()) {
+        cancellations->fetch_add(1, std::memory_order_release);
+      }
+    }
+  }
+
+  /// Whether cancel() has been called on this or any copy of this handle.
+  bool cancelled() const { return state_->cancelled.load(std::memory_order_relaxed); }
+
+  /// Has cancel() count into cancellations, right away if cancelled already. Batching pools watch the handles of the
+  /// requests they hold, to tell whether there can be sentences of cancelled requests to drop since they last looked,
+  /// unbothered by the cancellation of requests held elsewhere.
+  void watch(const std::shared_ptr<std::atomic<size_t>> &cancellations) const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    std::vector<std::weak_ptr<std::atomic<size_t>>> &watchers = state_->watchers;
+    bool watching = false;
+    for (auto itr = watchers.begin(); itr != watchers.end();) {
+      std::shared_ptr<std::atomic<size_t>> watcher = itr->lock();
+      watching = watching || watcher == cancellations;
+      itr = watcher ? std::next(itr) : watchers.erase(itr);
+    }
+    if (!watching) {
+      watchers.push_back(cancellations);
+      if (state_->cancelled.load(std::memory_order_relaxed)) {
+        cancellations->fetch_add(1, std::memory_order_release);
+      }
+    }
+  }
+
+ private:
+  struct State {
+    std::atomic<bool> cancelled{false};
+    std::mutex mutex;  // Guards watchers, and orders cancel() with watch().
+    std::vector<std::weak_ptr<std::atomic<size_t>>> watchers;  // Cancellation counts of batching pools, see watch().
+  };
+  std::shared_ptr<State> state_;
+};
+
 /// A Request is an internal representation used to represent a request after
 /// processed by TextProcessor into sentences constituted by marian::Words.
 ///
@@ -37,7 +93,7 @@ class TranslationModel;
 /// triggered with the compiled Histories, to construct the Response
 /// corresponding to the Request and set value of the promise which triggers the
 /// future at client.
-class Request {
+class Request : public std::enable_shared_from_this<Request> {
  public:
   /// Constructs an internal representation of the Request identified by Id,
   /// processed Segments and accepts a callback (ResponseBuilder) which builds
@@ -46,20 +102,31 @@ class Request {
   ///
   /// @param [in] Id: Identifier assigned to Request by Service.
   /// @param [in] model: TranslationModel for identifying a unique translation unit key (model, words in a sentence) for
-  /// cache.
+  /// cache. The Request shares ownership of the model, as the ResponseBuilder uses vocabularies and quality estimator
+  /// owned by it until the Response is built, which can be after the client has let go of the model.
   /// @param [in] segments: Each segment is a unit to be translated.
   /// @param [in] responseBuilder: Callback function (of ResponseBuilder type)
   /// to be triggered upon the completion of translation of all units in a
   /// Request.
+  /// @param [in] responseOptions: Options the Request was made with, supplying priority and deadline used in
+  /// scheduling.
   /// @param [in] cache: Cache supplied externally to attempt to fetch translations or store them after completion for
   /// reuse later.
-  Request(size_t Id, const TranslationModel &model, Segments &&segments, ResponseBuilder &&responseBuilder,
-          std::optional<TranslationCache> &cache);
+  /// @param [in] handle: Handle through which the client can cancel the Request.
+  /// @param [in] completer: Executor to build the Response on once the last segment is translated, instead of the
+  /// worker which translated it. If null, the Response is built on the worker.
+  Request(size_t Id, Ptr<const TranslationModel> model, Segments &&segments, ResponseBuilder &&responseBuilder,
+          const ResponseOptions &responseOptions, std::optional<TranslationCache> &cache,
+          const RequestHandle &handle = RequestHandle(), const Executor &completer = nullptr);
 
   /// Obtain the count of tokens in the segment correponding to index. Used to
   /// insert sentence from multiple requests into the corresponding size bucket.
   size_t segmentTokens(size_t index) const;
 
+  /// Obtain the size in bytes of the source text the segment corresponding to index is obtained from. Used to account
+  /// for memory held by pending requests.
+  size_t segmentBytes(size_t index) const;
+
   /// Obtain number of segments in a request.
   size_t numSegments() const;
 
@@ -68,20 +135,51 @@ class Request {
   Segment getSegment(size_t index) const;
 
   /// For notions of priority among requests, used to enable std::set in
-  /// BatchingPool.
+  /// BatchingPool. A Request compares less than another if it is more urgent: higher priority first, then earlier
+  /// deadline, then earlier arrival (lower Id).
   bool operator<(const Request &request) const;
 
   /// Processes a history obtained after translating in a heterogenous batch
-  /// compiled from requests.
+  /// compiled from requests. A null history marks the segment as dropped without translation, on cancellation or
+  /// expiry of the Request.
   void processHistory(size_t index, Ptr<History> history);
 
+  /// Whether the client has cancelled this Request, in which case its pending segments need not be translated.
+  bool cancelled() const { return handle_.cancelled(); }
+
+  /// Handle through which the client can cancel this Request.
+  const RequestHandle &handle() const { return handle_; }
+
+  /// Whether the deadline of this Request has passed by now, in which case its pending segments need not be translated.
+  bool expired(Deadline now) const { return now >= deadline_; }
+
+  /// Time the Request was made, on the thread submitting it, ahead of being handed over for batching.
+  std::chrono::steady_clock::time_point arrival() const { return arrival_; }
+
   bool cacheHitPrefilled(size_t index) const { return histories_[index] != nullptr; }
 
+  /// Streams the segments prefilled from cache to the client, and issues the Response if there are no segments left to
+  /// translate, as on completion from translation. Called once by whoever constructs the Request, right after and ahead
+  /// of enqueueing it, so that no client callback runs within the constructor.
+  void completePrefilled();
+
+  /// Completes the Request without translating the segments pending, issuing the Response marked with status. Segments
+  /// prefilled from cache are retained. Only for use on a Request which is yet to be enqueued for translation.
+  void abandon(Response::Status status);
+
  private:
+  /// Issues the Response from histories_ marked with status, on completer_ if set.
+  void complete(Response::Status status);
+
   size_t Id_;
 
-  /// TranslationModel associated with this request
-  const TranslationModel &model_;
+  /// Scheduling hints, see ResponseOptions.
+  int priority_;
+  Deadline deadline_;
+  std::chrono::steady_clock::time_point arrival_;
+
+  /// TranslationModel associated with this request, kept alive until the Response is built.
+  Ptr<const TranslationModel> model_;
 
   /// Multiple translation-workers can concurrently access the same Request. The
   /// following atomic atomically operates on the variable holding sentences
@@ -100,8 +198,17 @@ class Request {
   /// std::vector<Ptr<Vocab const>> *vocabs_;
   ResponseBuilder responseBuilder_;
 
+  /// Serializes streaming of sentences completed on different workers, so that the client sees one at a time.
+  std::mutex streamMutex_;
+
   /// Cache used to hold unit translations. If nullopt, means no-caching.
   std::optional<TranslationCache> &cache_;
+
+  /// Shared with the client, to signal cancellation.
+  RequestHandle handle_;
+
+  /// Where to build the Response on completion from translation, see constructor.
+  Executor completer_;
 };
 
 /// A RequestSentence provides a view to a sentence within a Request. Existence
@@ -116,6 +223,9 @@ class RequestSentence {
   /// order by length in batching.
   size_t numTokens() const;
 
+  /// Number of bytes in the source text of the segment this RequestSentence represents.
+  size_t numBytes() const;
+
   /// Accessor to the segment represented by the RequestSentence.
   Segment getUnderlyingSegment() const;
 
@@ -123,6 +233,15 @@ class RequestSentence {
   /// RequestSentence.
   void completeSentence(Ptr<History> history);
 
+  /// Whether the Request this sentence belongs to has been cancelled, or is past its deadline by now. Such sentences
+  /// are dropped instead of translated.
+  bool abandoned(Deadline now) const { return request_->cancelled() || request_->expired(now); }
+
+  /// Time the Request this sentence belongs to was made.
+  std::chrono::steady_clock::time_point arrival() const { return request_->arrival(); }
+
+  /// Orders by urgency of the underlying Request, and among sentences of the same Request by position in it. The
+  /// most urgent sentence compares least.
   friend bool operator<(const RequestSentence &a, const RequestSentence &b);
 
  private:
@@ -23,6 +23,14 @@ typedef std::vector<std::vector<float>> Alignment;
 /// sentences boundaries, which are required to interpret Quality and
 /// Alignment (s) at the moment.
 struct Response {
+  /// Outcome of the request the Response is constructed for.
+  enum Status {
+    SUCCESS,    // Every sentence translated.
+    REJECTED,   // Not admitted for translation, as the service is at its limit of pending work.
+    CANCELLED,  // Cancelled by the client through RequestHandle before all sentences were translated.
+    TIMED_OUT,  // Deadline in ResponseOptions passed before all sentences were translated.
+  };
+
   /// SentenceQualityScore  contains the quality data of a given translated sentence.
   /// It includes the confidence (proxied by log probabilities) of each decoded word
   /// (higher logprobs imply better-translated words), the ByteRanges of each term,
@@ -43,6 +51,10 @@ struct Response {
   /// alignment and quality information are available.
   const size_t size() const { return source.numSentences(); }
 
+  /// Whether all sentences were translated. If not, sentences left untranslated are empty in `target`, and neither
+  /// alignments nor quality-scores are available. HTML markup, if any, is not restored into source or target.
+  Status status{SUCCESS};
+
   /// source text and annotations of (sub-)words and sentences.
   AnnotatedText source;
 
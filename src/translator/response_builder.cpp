@@ -22,6 +22,20 @@ void ResponseBuilder::buildAlignments(Histories &histories, Response &response)
   }
 }
 
+void ResponseBuilder::streamSentence(size_t sentenceIdx, const History &history) {
+  if (!responseOptions_.sentenceCallback) {
+    return;
+  }
+
+  NBestList onebest = history.nBest(1);
+  Words words = std::get<0>(onebest[0]);
+
+  DecodedSentence &sentence = streamed_[sentenceIdx];
+  vocabs_.target()->decodeWithByteRanges(words, sentence.text, sentence.subwords, /*ignoreEOS=*/false);
+  sentence.decoded = true;
+  responseOptions_.sentenceCallback(sentenceIdx, std::string(sentence.text));
+}
+
 void ResponseBuilder::buildTranslatedText(Histories &histories, Response &response) {
   // Reserving length at least as much as source_ seems like a reasonable
   // thing to do to avoid reallocations.
@@ -31,19 +45,26 @@ void ResponseBuilder::buildTranslatedText(Histories &histories, Response &respon
     // TODO(jerin): Change hardcode of nBest = 1
 
     auto &history = histories[sentenceIdx];
-    NBestList onebest = history->nBest(1);
-
-    Result result = onebest[0];  // Expecting only one result;
-    Words words = std::get<0>(result);
 
     std::string decoded;
     std::vector<string_view> targetSentenceMappings;
-    vocabs_.target()->decodeWithByteRanges(words, decoded, targetSentenceMappings, /*ignoreEOS=*/false);
+    std::vector<string_view> *mappings = &targetSentenceMappings;
+
+    // Sentences left untranslated stay empty. Those streamed are decoded already.
+    if (!streamed_.empty() && streamed_[sentenceIdx].decoded) {
+      mappings = &streamed_[sentenceIdx].subwords;
+    } else if (history) {
+      NBestList onebest = history->nBest(1);
+
+      Result result = onebest[0];  // Expecting only one result;
+      Words words = std::get<0>(result);
+      vocabs_.target()->decodeWithByteRanges(words, decoded, targetSentenceMappings, /*ignoreEOS=*/false);
+    }
 
     // For each sentence, prepend the filler text between the corresponding
     // source-sentence and the source-sentence before.
     string_view pre = response.source.gap(sentenceIdx);
-    response.target.appendSentence(pre, targetSentenceMappings.begin(), targetSentenceMappings.end());
+    response.target.appendSentence(pre, mappings->begin(), mappings->end());
 
     // If this is the last history to be decoded and translated-text
     // constructed, append the text till the end, which could be spaces or
@@ -36,18 +36,25 @@ class ResponseBuilder {
         source_(std::move(source)),
         vocabs_(vocabs),
         callback_(std::move(callback)),
-        qualityEstimator_(qualityEstimator) {}
+        qualityEstimator_(qualityEstimator) {
+    if (responseOptions_.sentenceCallback) {
+      streamed_.resize(source_.numSentences());
+    }
+  }
 
   /// Constructs and sets the promise of a Response object from obtained
   /// histories after translating.
   /// @param [in] histories: Histories obtained after translating the Request
-  /// from which this functor is called.
-  void operator()(Histories &&histories) {
+  /// from which this functor is called. Untranslated sentences are nullptr, which is allowed only if status is not
+  /// SUCCESS.
+  /// @param [in] status: Status to mark the Response with.
+  void operator()(Histories &&histories, Response::Status status = Response::SUCCESS) {
     // TODO(jerinphilip) load ResponseOptions into options and turn build
     // functions on or off.
     // responseOptions_ is unused, but we can try something here.
     ABORT_IF(source_.numSentences() != histories.size(), "Mismatch in source and translated sentences");
     Response response;
+    response.status = status;
 
     // Move source_ into response.
     response.source = std::move(source_);
@@ -55,18 +62,28 @@ class ResponseBuilder {
     // Should be after source is set
     buildTranslatedText(histories, response);
 
-    // Should always be after buildTranslatedText
-    if (responseOptions_.qualityScores) {
-      buildQualityScores(histories, response);
-    }
+    // Should always be after buildTranslatedText. Incomplete translations do not get the optional members.
+    if (status == Response::SUCCESS) {
+      if (responseOptions_.qualityScores) {
+        buildQualityScores(histories, response);
+      }
 
-    if (responseOptions_.alignment || responseOptions_.HTML) {
-      buildAlignments(histories, response);
+      if (responseOptions_.alignment || responseOptions_.HTML) {
+        buildAlignments(histories, response);
+      }
     }
 
     callback_(std::move(response));
   }
 
+  /// Delivers the translation of the sentence at sentenceIdx in history to the sentence callback, if streaming was
+  /// requested through ResponseOptions. The sentence decoded is kept to build the Response from. Not to be called
+  /// concurrently.
+  void streamSentence(size_t sentenceIdx, const History &history);
+
+  /// Source text the Response is to be constructed for. Available only until the Response is constructed.
+  const AnnotatedText &source() const { return source_; }
+
  private:
   /// Builds qualityScores from histories and writes to response. expects
   /// buildTranslatedText to be run before to be able to obtain target text and
@@ -95,6 +112,17 @@ class ResponseBuilder {
   AnnotatedText source_;
 
   const QualityEstimator &qualityEstimator_;
+
+  /// A target sentence decoded, with the views of its subwords into text.
+  struct DecodedSentence {
+    std::string text;
+    std::vector<string_view> subwords;
+    bool decoded{false};
+  };
+
+  /// Sentences decoded on streaming, by index, for buildTranslatedText(...) to not decode them again. Sized once on
+  /// construction if streaming, so that the text views point into stays put.
+  std::vector<DecodedSentence> streamed_;
 };
 }  // namespace bergamot
 }  // namespace marian
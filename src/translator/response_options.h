@@ -1,16 +1,40 @@
 #ifndef SRC_BERGAMOT_RESPONSE_OPTIONS_H_
 #define SRC_BERGAMOT_RESPONSE_OPTIONS_H_
+#include <chrono>
+#include <functional>
 #include <string>
 
 namespace marian {
 namespace bergamot {
 
+/// Point in time used to express deadlines on requests.
+using Deadline = std::chrono::steady_clock::time_point;
+
+/// Receives the translation of the sentence at sentenceIdx in the source, as soon as it is available.
+using SentenceCallbackType = std::function<void(size_t sentenceIdx, std::string &&translation)>;
+
 /// ResponseOptions dictate how to construct a Response for an input string of
 /// text to be translated.
 struct ResponseOptions {
   bool qualityScores{false};  ///< Include quality-scores or not.
   bool alignment{false};      ///< Include alignments or not.
   bool HTML{false};           ///< Remove HTML tags from text and insert in output.
+
+  /// Scheduling hints, used by the batching mechanism to decide which sentences among several pending requests are
+  /// translated first.
+  int priority{0};  ///< Requests with higher priority are scheduled ahead of those with lower.
+
+  /// Among equal priority, requests due earlier are scheduled first. Sentences still pending once the deadline has
+  /// passed are dropped instead of translated, and the Response is marked `Response::TIMED_OUT`, with the sentences
+  /// translated by then.
+  Deadline deadline{Deadline::max()};
+
+  /// Streams sentences to the client as they are translated, ahead of the Response, if set. Sentences are delivered
+  /// one at a time but not in source order, identified by their index in Response::source; sentences found in cache
+  /// are delivered right away. The callback runs on the thread completing the sentence, and must not block. Every
+  /// sentence delivered precedes the Response. Streamed text is plain: with HTML on, markup is restored only in the
+  /// Response. Sentences dropped on cancellation are not delivered.
+  SentenceCallbackType sentenceCallback{nullptr};
 };
 
 }  // namespace bergamot
@@ -1,38 +1,69 @@
 #include "service.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <utility>
 
+#include "affinity.h"
 #include "batch.h"
 #include "byte_array_util.h"
 #include "definitions.h"
+#include "pivot.h"
 
 namespace marian {
 namespace bergamot {
 
 namespace {
 
-// Combines two responses with first.target == second.source mapping alignments etc accordingly.
-// There are several constraints which are matched by only the pivoting workflow in <>Service source, therefore this
-// function is not for external use and in a hidden namespace.
-Response combine(Response &&first, Response &&second) {
-  Response combined;
+std::optional<TranslationCache> makeOptionalCache(size_t size, size_t mutexBuckets) {
+  return size > 0 ? std::make_optional<TranslationCache>(size, mutexBuckets) : std::nullopt;
+}
 
-  // Compute alignment first using internal matrices and mappings.
-  if (first.alignments.size()) {
-    combined.alignments = remapAlignments(first, second);
+/// Source text in a group below which AsyncService::translateMultiple preprocesses on the calling thread alone, as
+/// handing work to other threads would cost more than it saves.
+constexpr size_t kMinBytesToSharePreprocessing = 64 * 1024;
+
+/// Indices 0 to size split into contiguous ranges, processed by whichever threads get to them first. A thread which
+/// gets to work once all ranges are taken up does nothing, so that help that comes late, or never, costs nothing.
+class SharedRanges {
+ public:
+  SharedRanges(size_t size, size_t numRanges, std::function<void(size_t)> process)
+      : size_(size), numRanges_(numRanges), process_(std::move(process)) {}
+
+  /// Processes ranges until none are left to take up.
+  void work() {
+    for (size_t range = next_++; range < numRanges_; range = next_++) {
+      for (size_t i = range * size_ / numRanges_; i < (range + 1) * size_ / numRanges_; i++) {
+        process_(i);
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (++done_ == numRanges_) {
+        finished_.notify_all();
+      }
+    }
   }
 
-  combined.source = std::move(first.source);
-  combined.target = std::move(second.target);
-  combined.qualityScores = std::move(second.qualityScores);
+  /// Waits for ranges taken up by other threads to be processed. To be called after work(), at which point no range
+  /// is left to take up, and process is not called again.
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    finished_.wait(lock, [this]() { return done_ == numRanges_; });
+  }
 
-  return combined;
-}
+ private:
+  const size_t size_;
+  const size_t numRanges_;
+  std::function<void(size_t)> process_;
+  std::atomic<size_t> next_{0};
 
-std::optional<TranslationCache> makeOptionalCache(size_t size, size_t mutexBuckets) {
-  return size > 0 ? std::make_optional<TranslationCache>(size, mutexBuckets) : std::nullopt;
-}
+  std::mutex mutex_;
+  std::condition_variable finished_;
+  size_t done_{0};
+};
 
 }  // namespace
 
@@ -40,9 +71,14 @@ BlockingService::BlockingService(const BlockingService::Config &config)
     : config_(config),
       requestId_(0),
       batchingPool_(),
-      cache_(makeOptionalCache(config.cacheSize, /*mutexBuckets = */ 1)),
-      logger_(config.logger),
-      workspace_(/*deviceId=*/0, config.workspaceSizeInMB) {}
+      cache_(makeOptionalCache(config.cacheSize, /*mutexBuckets = */ config.numWorkers)),
+      logger_(config.logger) {
+  ABORT_IF(config_.numWorkers == 0, "Number of workers should be at least 1");
+  workspaces_.reserve(config_.numWorkers);
+  for (size_t cpuId = 0; cpuId < config_.numWorkers; cpuId++) {
+    workspaces_.emplace_back(cpuId, config_.workspaceSizeInMB);
+  }
+}
 
 std::vector<Response> BlockingService::translateMultiple(std::shared_ptr<TranslationModel> translationModel,
                                                          std::vector<std::string> &&sources,
@@ -72,15 +108,59 @@ std::vector<Response> BlockingService::translateMultipleRaw(std::shared_ptr<Tran
     batchingPool_.enqueueRequest(translationModel, request);
   }
 
-  Batch batch;
-  Ptr<TranslationModel> model{nullptr};
-  while (batchingPool_.generateBatch(model, batch)) {
-    model->translateBatch(workspace_, batch);
-  }
+  translatePending();
 
   return responses;
 }
 
+void BlockingService::warmup(std::shared_ptr<TranslationModel> translationModel, bool translate) {
+  std::vector<std::thread> workers;
+  workers.reserve(workspaces_.size() - 1);
+  for (size_t cpuId = 1; cpuId < workspaces_.size(); cpuId++) {
+    workers.emplace_back([&translationModel, translate, this, cpuId] {
+      translationModel->warmup(workspaces_[cpuId], translate);
+    });
+  }
+  translationModel->warmup(workspaces_[0], translate);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+void BlockingService::translatePending() {
+  // batchingPool_ is not thread-safe, workers take turns on it. A worker finding nothing to batch is done: either
+  // nothing is pending, or what is pending is held back until batches in translation on other workers are released, in
+  // which case those workers go on to batch it.
+  std::mutex mutex;
+  auto work = [this, &mutex](Workspace &workspace) {
+    Batch batch;
+    Ptr<TranslationModel> model{nullptr};
+    while (true) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!batchingPool_.generateBatch(model, batch)) {
+          return;
+        }
+      }
+
+      model->translateBatch(workspace, batch);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      batchingPool_.releaseBatch(model);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(workspaces_.size() - 1);
+  for (size_t cpuId = 1; cpuId < workspaces_.size(); cpuId++) {
+    workers.emplace_back(work, std::ref(workspaces_[cpuId]));
+  }
+  work(workspaces_[0]);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
 std::vector<Response> BlockingService::pivotMultiple(std::shared_ptr<TranslationModel> first,
                                                      std::shared_ptr<TranslationModel> second,
                                                      std::vector<std::string> &&sources,
@@ -90,9 +170,14 @@ std::vector<Response> BlockingService::pivotMultiple(std::shared_ptr<Translation
     htmls.emplace_back(std::move(sources[i]), responseOptions[i].HTML);
   }
 
-  // Translate source to pivots. This is same as calling translateMultiple.
+  // Translate source to pivots. This is same as calling translateMultiple, except nothing is streamed: the client only
+  // wants sentences in the target language.
+  std::vector<ResponseOptions> pivotOptions = responseOptions;
+  for (ResponseOptions &options : pivotOptions) {
+    options.sentenceCallback = nullptr;
+  }
   std::vector<Response> sourcesToPivots;
-  sourcesToPivots = translateMultipleRaw(first, std::move(sources), responseOptions);
+  sourcesToPivots = translateMultipleRaw(first, std::move(sources), pivotOptions);
 
   // Translate pivots to targets, after we have outputs at pivot from first round. We cannot use translateMultiple here
   // because need consistency at pivot on both sides.
@@ -110,11 +195,7 @@ std::vector<Response> BlockingService::pivotMultiple(std::shared_ptr<Translation
     batchingPool_.enqueueRequest(second, request);
   }
 
-  Batch batch;
-  Ptr<TranslationModel> model{nullptr};
-  while (batchingPool_.generateBatch(model, batch)) {
-    model->translateBatch(workspace_, batch);
-  }
+  translatePending();
 
   // Combine both sides. They're associated by indices.
   std::vector<Response> finalResponses;
@@ -133,92 +214,356 @@ std::vector<Response> BlockingService::pivotMultiple(std::shared_ptr<Translation
 AsyncService::AsyncService(const AsyncService::Config &config)
     : requestId_(0),
       config_(config),
-      safeBatchingPool_(),
+      safeBatchingPool_(config.batchingPool),
+      dispatcher_(std::max<size_t>(config.numWorkers, std::thread::hardware_concurrency()), config.numWorkers,
+                  config.maxQueuedBatchesPerWorker),
       cache_(makeOptionalCache(config_.cacheSize, /*mutexBuckets=*/config_.numWorkers)),
       logger_(config.logger) {
   ABORT_IF(config_.numWorkers == 0, "Number of workers should be at least 1 in a threaded workflow");
+  safeBatchingPool_.setAccumulation(config_.batchFillWords,
+                                    std::chrono::microseconds(config_.maxBatchWaitInMicroseconds));
+  if (config_.numCompletionThreads > 0) {
+    completionPool_ = std::make_unique<CompletionPool>(config_.numCompletionThreads);
+    completer_ = completionPool_->executor();
+  }
+  if (config_.cpuAffinity.empty() && config_.numaAffinity) {
+    numaNodes_ = numaNodeCpus();
+    if (numaNodes_.empty()) {
+      LOG(warn, "No NUMA nodes found, leaving placement of workers to the scheduler");
+    }
+  }
+
   workers_.reserve(config_.numWorkers);
   for (size_t cpuId = 0; cpuId < config_.numWorkers; cpuId++) {
-    workspaces_.emplace_back(cpuId, config.workspaceSizeInMB);
-    workers_.emplace_back([cpuId, this] {
-      // Consumer thread main-loop. Note that this is an infinite-loop unless the monitor is explicitly told to
-      // shutdown, which happens in the destructor for this class.
-      Batch batch;
-      Ptr<TranslationModel> translationModel{nullptr};
-      while (safeBatchingPool_.generateBatch(translationModel, batch)) {
-        translationModel->translateBatch(workspaces_[cpuId], batch);
-      }
+    spawnWorker(cpuId);
+  }
+
+  batchFormer_ = std::thread([this] {
+    // Forms batches only as workers have room for them, so that batches are formed from the most recent view of
+    // pending requests. Exits when the monitor is told to shutdown, which happens in the destructor for this class.
+    Batch batch;
+    Ptr<TranslationModel> translationModel{nullptr};
+    while (dispatcher_.waitForRoom() && safeBatchingPool_.generateBatch(translationModel, batch)) {
+      dispatcher_.dispatch(std::move(translationModel), std::move(batch));
+    }
+    dispatcher_.shutdown();
+  });
+}
+
+std::vector<size_t> AsyncService::workerCpus(size_t cpuId) const {
+  if (!config_.cpuAffinity.empty()) {
+    return {config_.cpuAffinity[cpuId % config_.cpuAffinity.size()]};
+  }
+  if (!numaNodes_.empty()) {
+    return numaNodes_[cpuId % numaNodes_.size()];
+  }
+  return {};
+}
+
+void AsyncService::spawnWorker(size_t cpuId) {
+  workers_.emplace_back([cpuId, this] {
+    // Pinned before allocating anything, so that the workspace, and the replicas of backends created on translating,
+    // are first touched, and thereby placed, on the node the worker runs on.
+    std::vector<size_t> cpus = workerCpus(cpuId);
+    if (!cpus.empty() && !pinCurrentThread(cpus)) {
+      LOG(warn, "Could not pin worker {} to its cpus, leaving its placement to the scheduler", cpuId);
+    }
+    // Replicas created for the workspace, whether for batches or for tasks posted such as warmup, are freed along with
+    // it as the worker exits.
+    auto workspace = std::make_unique<Workspace>(cpuId, config_.workspaceSizeInMB);
+
+    // Consumer thread main-loop. Note that this is an infinite-loop unless the dispatcher is told to shutdown, which
+    // happens once the batch former exits, or this worker is retired.
+    Batch batch;
+    Ptr<TranslationModel> translationModel{nullptr};
+    while (dispatcher_.next(cpuId, *workspace, translationModel, batch)) {
+      translationModel->translateBatch(*workspace, batch);
+      safeBatchingPool_.releaseBatch(translationModel);
+
+      // Not held on to while waiting for the next batch, so that a model let go of by its owner (e.g. evicted from a
+      // ModelRegistry) is freed as soon as its last batch is done.
+      translationModel = nullptr;
+      batch.clear();
+    }
+  });
+}
+
+size_t AsyncService::setNumWorkers(size_t numWorkers) {
+  std::lock_guard<std::mutex> lock(resizeMutex_);
+  ABORT_IF(numWorkers == 0, "Number of workers should be at least 1 in a threaded workflow");
+  if (numWorkers > dispatcher_.capacity()) {
+    LOG(warn, "Number of workers {} exceeds capacity of {}, using {}", numWorkers, dispatcher_.capacity(),
+        dispatcher_.capacity());
+    numWorkers = dispatcher_.capacity();
+  }
+  config_.numWorkers = numWorkers;
+  size_t current = workers_.size();
+  dispatcher_.resize(numWorkers);
+  for (size_t cpuId = current; cpuId < numWorkers; cpuId++) {
+    spawnWorker(cpuId);
+  }
+
+  for (size_t cpuId = numWorkers; cpuId < current; cpuId++) {
+    workers_[cpuId].join();
+  }
+  if (numWorkers < current) {
+    workers_.resize(numWorkers);
+  }
+  return numWorkers;
+}
+
+void AsyncService::warmup(std::shared_ptr<TranslationModel> translationModel, bool translate) {
+  // Holding resizeMutex_ keeps every worker posted to around until it gets to the task.
+  std::lock_guard<std::mutex> lock(resizeMutex_);
+  std::vector<std::future<void>> warmed;
+  warmed.reserve(workers_.size());
+  for (size_t cpuId = 0; cpuId < workers_.size(); cpuId++) {
+    auto promise = std::make_shared<std::promise<void>>();
+    warmed.push_back(promise->get_future());
+    bool posted = dispatcher_.post(cpuId, [translationModel, translate, promise](Workspace &workspace) {
+      translationModel->warmup(workspace, translate);
+      promise->set_value();
     });
+    ABORT_IF(!posted, "Worker {} retired while held by warmup", cpuId);
   }
+
+  for (std::future<void> &future : warmed) {
+    future.wait();
+  }
+}
+
+size_t AsyncService::numWorkers() {
+  std::lock_guard<std::mutex> lock(resizeMutex_);
+  return workers_.size();
 }
 
 void AsyncService::clear() { safeBatchingPool_.clear(); }
 
 AsyncService::~AsyncService() {
+  std::lock_guard<std::mutex> lock(resizeMutex_);
+
+  // The first leg of a pivot enqueues the second from workers, so the batching pool is shut down only once no pivot
+  // has requests left. Pivots with requests removed by clear() have none left as soon as those in translation are done.
+  {
+    std::unique_lock<std::mutex> pivotLock(pivotMutex_);
+    pivotsDone_.wait(pivotLock, [this]() { return pivotsInFlight_ == 0; });
+  }
   safeBatchingPool_.shutdown();
+  batchFormer_.join();
   for (std::thread &worker : workers_) {
     assert(worker.joinable());
     worker.join();
   }
   workers_.clear();
-}
-
-void AsyncService::pivot(std::shared_ptr<TranslationModel> first, std::shared_ptr<TranslationModel> second,
-                         std::string &&source, CallbackType clientCallback, const ResponseOptions &responseOptions) {
-  Ptr<HTML> html = std::make_shared<HTML>(std::move(source), responseOptions.HTML);
-  // This is callback chaining or CPS due to async.
 
-  // We create a callback which feeds the result of first into a second translation (internalCallback), which is
-  // supplied with a callback (joiningCallback) which merges both results and creates our final response.
-  //
-
-  auto internalCallback = [this, clientCallback, second, responseOptions, html](Response &&sourceToPivot) {
-    // We cannot eliminate the following copy, as we need two versions of intermediate. Holding
-    // it in a copy allows moving the response into the lambda below.
+  // Completions handed over by workers are done by the time this returns, as with completions on workers.
+  if (completionPool_) {
+    completionPool_->shutdown();
+  }
+}
 
-    AnnotatedText intermediate = sourceToPivot.target;
+RequestHandle AsyncService::pivot(std::shared_ptr<TranslationModel> first, std::shared_ptr<TranslationModel> second,
+                                  std::string &&source, CallbackType clientCallback,
+                                  const ResponseOptions &responseOptions) {
+  RequestHandle handle;
+  pivotWithHandle(first, second, std::move(source), clientCallback, responseOptions, handle);
+  return handle;
+}
 
-    // https://stackoverflow.com/a/65606554/4565794
-    // Move semantics only work on mutable lambdas, and can only be done once. It's only once in our case, so issok.
-    auto joiningCallback = [this, sourceToPivot = std::move(sourceToPivot), clientCallback,
-                            html](Response &&pivotToTarget) mutable {
-      // We have both Responses at this callback, sourceToPivot is moved in, second half will be available when
-      // complete.
-      Response finalResponse = combine(std::move(sourceToPivot), std::move(pivotToTarget));
+std::future<Response> AsyncService::pivot(std::shared_ptr<TranslationModel> first,
+                                          std::shared_ptr<TranslationModel> second, std::string &&source,
+                                          const ResponseOptions &responseOptions, const RequestHandle &handle) {
+  auto promise = std::make_shared<std::promise<Response>>();
+  std::future<Response> future = promise->get_future();
+  auto callback = [promise](Response &&response) { promise->set_value(std::move(response)); };
+  pivotWithHandle(first, second, std::move(source), callback, responseOptions, handle);
+  return future;
+}
 
-      // Sentences should be consistent now, give way to client.
-      html->restore(finalResponse);
-      clientCallback(std::move(finalResponse));
+void AsyncService::pivotWithHandle(std::shared_ptr<TranslationModel> first, std::shared_ptr<TranslationModel> second,
+                                   std::string &&source, CallbackType clientCallback,
+                                   const ResponseOptions &responseOptions, const RequestHandle &handle) {
+  Ptr<HTML> html = std::make_shared<HTML>(std::move(source), responseOptions.HTML);
+  {
+    std::lock_guard<std::mutex> lock(pivotMutex_);
+    ++pivotsInFlight_;
+  }
+  auto done = [this]() {
+    // Notified with the lock held, as the destructor waiting on it may go ahead as soon as the lock is released.
+    std::lock_guard<std::mutex> lock(pivotMutex_);
+    if (--pivotsInFlight_ == 0) {
+      pivotsDone_.notify_all();
+    }
+  };
+  auto join = std::make_shared<PivotJoin>(clientCallback, html, done);
+
+  // Pivoting is pipelined at sentence level: each sentence translated to the pivot is issued to the second model right
+  // away, as a request of its own, instead of waiting for the first leg to complete. The second model works on early
+  // sentences while the first is still at later ones. PivotJoin assembles the final Response once all are in.
+  SentenceCallbackType clientSentenceCallback = responseOptions.sentenceCallback;
+  ResponseOptions pivotOptions = responseOptions;
+  pivotOptions.sentenceCallback = [this, second, responseOptions, clientSentenceCallback, join, handle](
+                                      size_t sentenceIdx, std::string &&pivot) {
+    AnnotatedText intermediate(std::move(pivot));
+    std::vector<string_view> sentence{string_view(intermediate.text.data(), intermediate.text.size())};
+    intermediate.recordExistingSentence(sentence.begin(), sentence.end(), intermediate.text.data());
+
+    // Sentences are streamed to the client from the second leg, at their index in source.
+    ResponseOptions sentenceOptions = responseOptions;
+    sentenceOptions.sentenceCallback = nullptr;
+    if (clientSentenceCallback) {
+      sentenceOptions.sentenceCallback = [clientSentenceCallback, sentenceIdx](size_t, std::string &&translation) {
+        clientSentenceCallback(sentenceIdx, std::move(translation));
+      };
+    }
+
+    auto callback = [join, sentenceIdx](Response &&pivotToTarget) {
+      join->completeSentence(sentenceIdx, std::move(pivotToTarget));
     };
 
-    // Second call.
+    // Bypasses admission control, the work was admitted with the first leg.
+    join->issue();
     Ptr<Request> request =
-        second->makePivotRequest(requestId_++, std::move(intermediate), joiningCallback, responseOptions, cache_);
+        second->makePivotRequest(requestId_++, std::move(intermediate), callback, sentenceOptions, cache_, handle,
+                                 completer_);
     safeBatchingPool_.enqueueRequest(second, request);
   };
 
-  // First call.
-  translateRaw(first, std::move(source), internalCallback, responseOptions);
+  auto firstCallback = [join](Response &&sourceToPivot) { join->completeFirst(std::move(sourceToPivot)); };
+  translateRaw(first, std::move(source), firstCallback, pivotOptions, handle);
+}
+
+RequestHandle AsyncService::translate(std::shared_ptr<TranslationModel> translationModel, std::string &&source,
+                                      CallbackType callback, const ResponseOptions &responseOptions) {
+  RequestHandle handle;
+  translateWithHandle(translationModel, std::move(source), callback, responseOptions, handle);
+  return handle;
+}
+
+std::future<Response> AsyncService::translate(std::shared_ptr<TranslationModel> translationModel,
+                                              std::string &&source, const ResponseOptions &responseOptions,
+                                              const RequestHandle &handle) {
+  auto promise = std::make_shared<std::promise<Response>>();
+  std::future<Response> future = promise->get_future();
+  auto callback = [promise](Response &&response) { promise->set_value(std::move(response)); };
+  translateWithHandle(translationModel, std::move(source), callback, responseOptions, handle);
+  return future;
 }
 
-void AsyncService::translate(std::shared_ptr<TranslationModel> translationModel, std::string &&source,
-                             CallbackType callback, const ResponseOptions &responseOptions) {
+void AsyncService::translateWithHandle(std::shared_ptr<TranslationModel> translationModel, std::string &&source,
+                                       CallbackType callback, const ResponseOptions &responseOptions,
+                                       const RequestHandle &handle) {
   // Producer thread, a call to this function adds new work items. If batches are available, notifies workers waiting.
   Ptr<HTML> html = std::make_shared<HTML>(std::move(source), responseOptions.HTML);
   auto internalCallback = [html, callback](Response &&response) {
-    html->restore(response);
+    if (response.status == Response::SUCCESS) {
+      html->restore(response);
+    }
     callback(std::move(response));
   };
 
-  translateRaw(translationModel, std::move(source), internalCallback, responseOptions);
+  translateRaw(translationModel, std::move(source), internalCallback, responseOptions, handle);
+}
+
+RequestHandle AsyncService::translateMultiple(std::shared_ptr<TranslationModel> translationModel,
+                                              std::vector<std::string> &&sources, MultipleCallbackType callback,
+                                              const std::vector<ResponseOptions> &responseOptions) {
+  ABORT_IF(responseOptions.size() != sources.size(), "Expected ResponseOptions for each of {} sources, got {}",
+           sources.size(), responseOptions.size());
+  RequestHandle handle;
+  if (sources.empty()) {
+    callback(std::vector<Response>());
+    return handle;
+  }
+
+  // Responses of the group are collected here, the last to complete hands them over to the client.
+  struct Group {
+    std::vector<Response> responses;
+    std::atomic<size_t> pending;
+    MultipleCallbackType callback;
+  };
+  auto group = std::make_shared<Group>();
+  group->responses.resize(sources.size());
+  group->pending = sources.size();
+  group->callback = std::move(callback);
+
+  // Preprocessing (markup, sentence splitting, tokenization, cache lookups) is independent across inputs. A large group
+  // is shared out in contiguous ranges with the workers, through tasks run ahead of their next batch. The calling
+  // thread works through ranges too, and waits only on those taken up by workers. A worker busy translating, or the
+  // calling thread being a worker itself (in a callback), makes for less help, but never for a wait.
+  std::vector<Ptr<Request>> requests(sources.size());
+  auto prepare = [&](size_t i) {
+    Ptr<HTML> html = std::make_shared<HTML>(std::move(sources[i]), responseOptions[i].HTML);
+    auto internalCallback = [group, html, i](Response &&response) {
+      if (response.status == Response::SUCCESS) {
+        html->restore(response);
+      }
+      group->responses[i] = std::move(response);
+      if (--group->pending == 0) {
+        group->callback(std::move(group->responses));
+      }
+    };
+    requests[i] = translationModel->makeRequest(requestId_++, std::move(sources[i]), internalCallback,
+                                                responseOptions[i], cache_, handle, completer_);
+  };
+
+  size_t bytes = 0;
+  for (const std::string &source : sources) {
+    bytes += source.size();
+  }
+
+  size_t numWorkers = dispatcher_.numWorkers();
+  if (bytes < kMinBytesToSharePreprocessing || sources.size() == 1) {
+    for (size_t i = 0; i < sources.size(); i++) {
+      prepare(i);
+    }
+  } else {
+    // Workers retired since numWorkers was read turn the task down, and are of no help.
+    auto ranges = std::make_shared<SharedRanges>(sources.size(), std::min(numWorkers + 1, sources.size()), prepare);
+    for (size_t workerId = 0; workerId < numWorkers; workerId++) {
+      dispatcher_.post(workerId, [ranges](Workspace &) { ranges->work(); });
+    }
+    ranges->work();
+    ranges->wait();
+  }
+
+  // Requests from different producers do not interleave within the group, which keeps its order of arrival.
+  if (!config_.batchingPool.limitsPending()) {
+    safeBatchingPool_.enqueueRequest(translationModel, requests);
+    return handle;
+  }
+
+  std::chrono::microseconds timeout(config_.admissionTimeoutInMicroseconds);
+  if (!safeBatchingPool_.tryEnqueueRequest(timeout, translationModel, requests)) {
+    for (Ptr<Request> &request : requests) {
+      // Requests served entirely from cache have completed already.
+      if (BatchingPool::toBeTranslated(*request).sentences > 0) {
+        request->abandon(Response::REJECTED);
+      }
+    }
+  }
+  return handle;
 }
 
 void AsyncService::translateRaw(std::shared_ptr<TranslationModel> translationModel, std::string &&source,
-                                CallbackType callback, const ResponseOptions &responseOptions) {
+                                CallbackType callback, const ResponseOptions &responseOptions,
+                                const RequestHandle &handle) {
   // Producer thread, a call to this function adds new work items. If batches are available, notifies workers waiting.
   Ptr<Request> request =
-      translationModel->makeRequest(requestId_++, std::move(source), callback, responseOptions, cache_);
-  safeBatchingPool_.enqueueRequest(translationModel, request);
+      translationModel->makeRequest(requestId_++, std::move(source), callback, responseOptions, cache_, handle,
+                                    completer_);
+  if (!config_.batchingPool.limitsPending()) {
+    // Nothing to check for admission, which allows for the hand over to workers that does not take locks.
+    safeBatchingPool_.enqueueRequest(translationModel, request);
+    return;
+  }
+
+  std::chrono::microseconds timeout(config_.admissionTimeoutInMicroseconds);
+  // A request served entirely from cache has completed already.
+  if (!safeBatchingPool_.tryEnqueueRequest(timeout, translationModel, request) &&
+      BatchingPool::toBeTranslated(*request).sentences > 0) {
+    request->abandon(Response::REJECTED);
+  }
 }
 
 }  // namespace bergamot
@@ -1,11 +1,18 @@
 #ifndef SRC_BERGAMOT_SERVICE_H_
 #define SRC_BERGAMOT_SERVICE_H_
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
 #include <queue>
 #include <thread>
 #include <vector>
 
+#include "batch_dispatcher.h"
 #include "cache.h"
+#include "completion_pool.h"
 #include "data/types.h"
 #include "logging.h"
 #include "quality_estimator.h"
@@ -18,6 +25,14 @@
 #include "translator/parser.h"
 #include "vocabs.h"
 
+// Coroutine support, available to clients compiling with C++20.
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define BERGAMOT_COROUTINES
+#endif
+#endif
+
 namespace marian {
 namespace bergamot {
 
@@ -40,6 +55,19 @@ class Workspace {
     tensors_->reserve(workspaceSizeInMB);
   }
 
+  Workspace(Workspace &&) = default;
+  Workspace(const Workspace &) = delete;
+
+  /// Frees the replicas of backends created for this workspace, which are of no use to anyone else. Workers are
+  /// respawned with the ids of those retired, and would otherwise be handed replicas bound to a workspace since gone.
+  ~Workspace() {
+    for (std::weak_ptr<TranslationModel> &model : models_) {
+      if (std::shared_ptr<TranslationModel> replicated = model.lock()) {
+        replicated->releaseBackend(id());
+      }
+    }
+  }
+
   Ptr<TensorAllocator> tensors() { return tensors_; }
   Ptr<TensorAllocator> cache() { return New<TensorAllocator>(backend_); }
 
@@ -49,11 +77,22 @@ class Workspace {
 
   void clear() { tensors_->clear(); }
 
+  /// Records that model created a replica of its backend for this workspace, to be freed along with the workspace.
+  /// Called by the thread owning the workspace only.
+  void addReplica(std::weak_ptr<TranslationModel> model) {
+    // Models freed since are of no interest, and with models loaded and freed over time would pile up.
+    models_.erase(std::remove_if(models_.begin(), models_.end(),
+                                 [](const std::weak_ptr<TranslationModel> &other) { return other.expired(); }),
+                  models_.end());
+    models_.push_back(std::move(model));
+  }
+
  private:
   Ptr<TensorAllocator> tensors_{nullptr};
   const marian::DeviceId device_;
   const marian::Type precision_;
   Ptr<Backend> backend_;
+  std::vector<std::weak_ptr<TranslationModel>> models_;  // Models with a replica of their backend for this workspace.
 
   Ptr<Options> horribleOptionsHack() {
     Ptr<Options> options = std::make_shared<Options>();
@@ -67,6 +106,7 @@ class Workspace {
 
 class BlockingService;
 class AsyncService;
+class TranslationAwaitable;
 
 /// See AsyncService.
 ///
@@ -83,6 +123,10 @@ class BlockingService {
 
     size_t workspaceSizeInMB{1024};
 
+    /// Number of threads translating batches within a call, each with a workspace of its own. The calling thread is
+    /// one of them, the others only live for the duration of the call.
+    size_t numWorkers{1};
+
     Logger::Config logger;  ///< Configurations for logging
 
     template <class App>
@@ -90,6 +134,7 @@ class BlockingService {
       // Options will come here.
       app.add_option("--cache-size", config.cacheSize, "Number of entries to store in cache.");
       app.add_option("--workspace-size", config.workspaceSizeInMB, "Workspace size to use");
+      app.add_option("--cpu-threads", config.numWorkers, "Threads to translate with");
 
       Logger::Config::addOptions(app, config.logger);
     }
@@ -102,6 +147,9 @@ class BlockingService {
   /// all text-blobs dictating how to construct Response. ResponseOptions can be used to enable/disable additional
   /// information like quality-scores, alignments etc.
 
+  /// Batches are translated by `numWorkers` threads for the duration of the call (see Config). Responses are in the
+  /// order of the input regardless.
+
   /// If you have async/multithread capabilities, it is recommended to work with AsyncService instead of this class.
   /// Note that due to batching differences and consequent floating-point rounding differences, this is not guaranteed
   /// to have the same output as AsyncService.
@@ -131,11 +179,19 @@ class BlockingService {
                                       const std::vector<ResponseOptions> &responseOptions);
   TranslationCache::Stats cacheStats() { return cache_ ? cache_->stats() : TranslationCache::Stats(); }
 
+  /// Creates the replicas of the backend of translationModel for every worker, concurrently, so that the first call
+  /// translating with it does not pay for creating them. See TranslationModel::warmup(...) for translate.
+  void warmup(std::shared_ptr<TranslationModel> translationModel, bool translate = true);
+
  private:
   std::vector<Response> translateMultipleRaw(std::shared_ptr<TranslationModel> translationModel,
                                              std::vector<std::string> &&source,
                                              const std::vector<ResponseOptions> &responseOptions);
 
+  /// Translates everything pending in batchingPool_, spreading batches over workspaces_ with config_.numWorkers
+  /// threads including the calling one. Returns when all are done.
+  void translatePending();
+
   ///  Numbering requests processed through this instance. Used to keep account of arrival times of the request. This
   ///  allows for using this quantity in priority based ordering.
   size_t requestId_;
@@ -150,7 +206,8 @@ class BlockingService {
   Logger logger_;
   std::optional<TranslationCache> cache_;
 
-  Workspace workspace_;
+  /// One workspace per worker, kept across calls.
+  std::vector<Workspace> workspaces_;
 };
 
 /// Effectively a threadpool, providing an API to take a translation request of a source-text, paramaterized by
@@ -163,6 +220,34 @@ class AsyncService {
     size_t cacheSize{0};   ///< Size in History items to be stored in the cache. Loosely corresponds to sentences to
                            /// cache in the real world. A value of 0 means no caching.
     size_t workspaceSizeInMB{1024};
+
+    /// Words to accumulate in pending requests before a worker forms a batch. Larger values give fuller batches under
+    /// moderate load, at the expense of latency. A value of 0 means workers take whatever is pending.
+    size_t batchFillWords{0};
+    /// Maximum time a worker holds off waiting for batchFillWords to accumulate, bounding the added latency.
+    size_t maxBatchWaitInMicroseconds{0};
+
+    /// Maximum time a call to translate/pivot blocks waiting for pending work to come down to within the limits in
+    /// batchingPool, after which the request is rejected. A value of 0 rejects right away if the limits are hit.
+    size_t admissionTimeoutInMicroseconds{0};
+
+    /// Batches formed ahead per worker, waiting for it (or another worker stealing from it) to be free. The default of
+    /// 0 forms a batch only once a worker is free to translate it, so that batches are formed from the latest view of
+    /// pending requests, and urgent requests are not queued behind batches formed earlier.
+    size_t maxQueuedBatchesPerWorker{0};
+
+    /// Threads building Responses, restoring HTML and running client callbacks once translation of a request is done,
+    /// so that workers can go on translating. A value of 0 leaves this to the worker completing the request.
+    size_t numCompletionThreads{0};
+
+    /// Placement of workers on cpus. If cpuAffinity is set, worker i is pinned to cpu `cpuAffinity[i % size]`. Else if
+    /// numaAffinity is set, workers are spread round-robin over NUMA nodes, each pinned to the cpus of its node. A
+    /// worker allocates its workspace and replicas of backends after it is pinned, so that they are local to it.
+    std::vector<size_t> cpuAffinity;
+    bool numaAffinity{false};
+
+    AggregateBatchingPool::Config batchingPool;  ///< Limits on sharing workers and pending work among models.
+
     Logger::Config logger;  // Configurations for logging
 
     template <class App>
@@ -170,6 +255,19 @@ class AsyncService {
       app.add_option("--cpu-threads", config.numWorkers, "Workers to form translation backend");
       app.add_option("--cache-size", config.cacheSize, "Number of entries to store in cache.");
       app.add_option("--workspace-size", config.workspaceSizeInMB, "Workspace size to use");
+      app.add_option("--batch-fill-words", config.batchFillWords,
+                     "Words to accumulate in pending requests before forming a batch, 0 to not wait");
+      app.add_option("--max-batch-wait", config.maxBatchWaitInMicroseconds,
+                     "Maximum time in microseconds to wait for --batch-fill-words to accumulate");
+      app.add_option("--admission-timeout", config.admissionTimeoutInMicroseconds,
+                     "Maximum time in microseconds to wait for room in queue before rejecting a request");
+      app.add_option("--max-queued-batches", config.maxQueuedBatchesPerWorker,
+                     "Batches formed ahead for each worker to translate next, 0 to form batches only for idle workers");
+      app.add_option("--completion-threads", config.numCompletionThreads,
+                     "Threads to build responses on, 0 to build them on translation workers");
+      app.add_option("--cpu-affinity", config.cpuAffinity, "Cpus to pin workers to, one per worker, round-robin");
+      app.add_flag("--numa-affinity", config.numaAffinity, "Pin workers to NUMA nodes, round-robin");
+      AggregateBatchingPool::Config::addOptions(app, config.batchingPool);
       Logger::Config::addOptions(app, config.logger);
     }
   };
@@ -181,19 +279,53 @@ class AsyncService {
   /// indicated via ResponseOptions. Upon completion translation of the input, the client supplied callback is
   /// triggered with the constructed Response. Concurrent-calls to this function are safe.
   ///
+  /// If limits on pending work are configured (see AggregateBatchingPool::Config) and admitting the input would exceed
+  /// them, the call blocks for up to `admissionTimeoutInMicroseconds`. If there is still no room, the callback is
+  /// triggered on the calling thread with a Response marked `Response::REJECTED`.
+  ///
+  /// The translation can be cancelled through the RequestHandle returned, see RequestHandle.
+  ///
+  /// Sentences can be consumed as they are translated, before the Response, through
+  /// `ResponseOptions::sentenceCallback`.
+  ///
   /// @param [in] translationModel: TranslationModel to use for the request.
   /// @param [in] source: rvalue reference of the string to be translated. This is available as-is to the client later
   /// in the Response corresponding to this call along with the translated-text and meta-data.
   /// @param [in] callback: A callback function provided by the client which accepts an rvalue of a Response.
   /// @param [in] responseOptions: Options indicating whether or not to include some member in the Response, also
   /// specify any additional configurable parameters.
-  void translate(std::shared_ptr<TranslationModel> translationModel, std::string &&source, CallbackType callback,
-                 const ResponseOptions &options = ResponseOptions());
+  /// @returns handle through which the translation can be cancelled.
+  RequestHandle translate(std::shared_ptr<TranslationModel> translationModel, std::string &&source,
+                          CallbackType callback, const ResponseOptions &options = ResponseOptions());
+
+  /// Same as translate(...) with a callback, except the Response is made available through a future.
+  ///
+  /// @param [in] handle: Handle through which the client can cancel the translation.
+  std::future<Response> translate(std::shared_ptr<TranslationModel> translationModel, std::string &&source,
+                                  const ResponseOptions &options = ResponseOptions(),
+                                  const RequestHandle &handle = RequestHandle());
+
+  /// Translates multiple inputs as a group, which saves per-input overheads of translate(...) for bulk work: inputs are
+  /// preprocessed together, a large group in parallel with workers free to help, and handed over to the workers all at
+  /// once. Admission applies to the group as a whole. The callback is triggered once, when all inputs are complete,
+  /// with Responses in the order of sources.
+  ///
+  /// @param [in] translationModel: TranslationModel to use for the inputs.
+  /// @param [in] sources: rvalue reference of the strings to be translated.
+  /// @param [in] callback: A callback function provided by the client which accepts an rvalue of the Responses.
+  /// @param [in] responseOptions: Options per input, see translate(...). One for each of sources.
+  /// @returns handle through which the translation of all inputs can be cancelled.
+  RequestHandle translateMultiple(std::shared_ptr<TranslationModel> translationModel,
+                                  std::vector<std::string> &&sources, MultipleCallbackType callback,
+                                  const std::vector<ResponseOptions> &responseOptions);
 
   /// With the supplied two translation models, translate using first and then the second generating a response as if it
   /// were translated from first's source language to second's target langauge. Requires first's target to be second's
   /// source to work correctly - effectively implementing pivoting translation via an intermediate language.
   ///
+  /// Each sentence is translated by second as soon as it is available in the pivot language, so that both models work
+  /// on the input at the same time.
+  ///
   /// @param[in] first: TranslationModel capable of translating from source language to pivot language.
   /// @param[in] second: TranslationModel capable of translating between pivot and target language.
   /// @param[move] source: The source text to be translated
@@ -201,33 +333,107 @@ class AsyncService {
   /// consume the Response.
   /// @param[in] options: Options indicating whether or not to include optional members in response and pass additional
   /// configurations. See ResponseOptions.
-  void pivot(std::shared_ptr<TranslationModel> first, std::shared_ptr<TranslationModel> second, std::string &&source,
-             CallbackType clientCallback, const ResponseOptions &options = ResponseOptions());
+  /// @returns handle through which the translation can be cancelled, covering both legs.
+  RequestHandle pivot(std::shared_ptr<TranslationModel> first, std::shared_ptr<TranslationModel> second,
+                      std::string &&source, CallbackType clientCallback,
+                      const ResponseOptions &options = ResponseOptions());
+
+  /// Same as pivot(...) with a callback, except the Response is made available through a future.
+  ///
+  /// @param [in] handle: Handle through which the client can cancel the translation.
+  std::future<Response> pivot(std::shared_ptr<TranslationModel> first, std::shared_ptr<TranslationModel> second,
+                              std::string &&source, const ResponseOptions &options = ResponseOptions(),
+                              const RequestHandle &handle = RequestHandle());
+
+#ifdef BERGAMOT_COROUTINES
+  /// Awaitable counterpart of translate(...), for use in C++20 coroutines:
+  ///
+  /// ```cpp
+  ///   Response response = co_await service.translateAwaitable(model, std::move(source));
+  /// ```
+  ///
+  /// @param [in] executor: Executor to resume the awaiting coroutine on once the Response is ready. If null, the
+  /// coroutine is resumed on the thread completing the translation. That is a worker unless `numCompletionThreads` is
+  /// set, and the continuation then holds back translation of other requests until its next suspension.
+  /// @param [in] handle: Handle through which the client can cancel the translation.
+  TranslationAwaitable translateAwaitable(std::shared_ptr<TranslationModel> translationModel, std::string &&source,
+                                          const ResponseOptions &options = ResponseOptions(),
+                                          Executor executor = nullptr, const RequestHandle &handle = RequestHandle());
+#endif
 
   /// Clears all pending requests.
   void clear();
 
+  /// Changes the number of worker threads to numWorkers, at least 1 and at most the larger of `numWorkers` in Config
+  /// and the number of hardware threads, to which larger values are clamped with a warning. Workers added get
+  /// workspaces of their own, and are placed as configured. Workers removed finish the batch they are translating, and
+  /// then free their workspace along with the replicas of backends in TranslationModels they used. Pending requests are
+  /// unaffected. Blocks until workers removed are gone; not to be called from a callback. Returns the number of workers
+  /// now in use.
+  size_t setNumWorkers(size_t numWorkers);
+
+  /// Has every worker create its replica of the backend of translationModel, all at the same time, so that requests
+  /// which follow are translated at steady-state latency instead of waiting on replicas being created on first use. See
+  /// TranslationModel::warmup(...) for translate. A worker gets to it once done with the batch in hand. Blocks until
+  /// all are done; not to be called from a callback. Workers added later create their replicas on first use.
+  void warmup(std::shared_ptr<TranslationModel> translationModel, bool translate = true);
+
+  /// Number of worker threads currently translating.
+  size_t numWorkers();
+
   /// Thread joins and proper shutdown are required to be handled explicitly.
-  /// If you do not want to wait, call `clear()` before destructor.
+  /// If you do not want to wait, call `clear()` before destructor. Pivots in flight are seen through both legs.
   ~AsyncService();
 
   TranslationCache::Stats cacheStats() { return cache_ ? cache_->stats() : TranslationCache::Stats(); }
 
+  /// Queue depth gauges: sentences, words and bytes of source text pending translation across all models.
+  BatchingPool::Stats queueStats() { return safeBatchingPool_.pendingStats(); }
+
+  /// Queue depth gauges for sentences pending translation with translationModel.
+  BatchingPool::Stats queueStats(const std::shared_ptr<TranslationModel> &translationModel) {
+    return safeBatchingPool_.pendingStats(translationModel);
+  }
+
  private:
+  friend class TranslationAwaitable;
+
+  /// Implementations of translate(...) and pivot(...), for a handle supplied by the caller.
+  void translateWithHandle(std::shared_ptr<TranslationModel> translationModel, std::string &&source,
+                           CallbackType callback, const ResponseOptions &options, const RequestHandle &handle);
+  void pivotWithHandle(std::shared_ptr<TranslationModel> first, std::shared_ptr<TranslationModel> second,
+                       std::string &&source, CallbackType clientCallback, const ResponseOptions &options,
+                       const RequestHandle &handle);
+
   void translateRaw(std::shared_ptr<TranslationModel> translationModel, std::string &&source, CallbackType callback,
-                    const ResponseOptions &options = ResponseOptions());
+                    const ResponseOptions &options, const RequestHandle &handle);
 
+  /// Starts the worker identified by cpuId, which creates its own workspace.
+  void spawnWorker(size_t cpuId);
+
+  /// Cpus to pin the worker identified by cpuId to, as configured. Empty for no pinning.
+  std::vector<size_t> workerCpus(size_t cpuId) const;
+
+  /// As constructed with, except for `numWorkers`, which follows setNumWorkers(...) under resizeMutex_.
   AsyncService::Config config_;
 
+  /// Workers by cpuId. Changed only under resizeMutex_, see setNumWorkers(...).
   std::vector<std::thread> workers_;
-  std::vector<Workspace> workspaces_;
+  std::mutex resizeMutex_;
+
+  /// CPUs of each NUMA node, if workers are placed by node.
+  std::vector<std::vector<size_t>> numaNodes_;
+
+  /// Forms batches from safeBatchingPool_ and dispatches them to workers through dispatcher_.
+  std::thread batchFormer_;
+  BatchDispatcher dispatcher_;
 
   /// Stores requestId of active request. Used to establish
   /// ordering among requests and logging/book-keeping.
 
   /// Numbering requests processed through this instance. Used to keep account of arrival times of the request. This
-  /// allows for using this quantity in priority based ordering.
-  size_t requestId_;
+  /// allows for using this quantity in priority based ordering. Atomic, as pivoting issues requests from workers.
+  std::atomic<size_t> requestId_;
 
   /// An aggregate batching pool associated with an async translating instance, which maintains an aggregate queue of
   /// requests compiled from  batching-pools of multiple translation models. The batching pool is wrapped around one
@@ -237,8 +443,72 @@ class AsyncService {
   // Logger which shuts down cleanly with service.
   Logger logger_;
   std::optional<TranslationCache> cache_;
+
+  /// Completes requests if Config::numCompletionThreads is not 0, in which case completer_ submits to it.
+  std::unique_ptr<CompletionPool> completionPool_;
+  Executor completer_;
+
+  /// Pivots with requests yet to complete, see pivot(...), which the destructor waits on.
+  std::mutex pivotMutex_;
+  std::condition_variable pivotsDone_;
+  size_t pivotsInFlight_{0};
 };
 
+#ifdef BERGAMOT_COROUTINES
+/// Awaitable translation, see AsyncService::translateAwaitable(...). Translation starts once awaited.
+class TranslationAwaitable {
+ public:
+  TranslationAwaitable(AsyncService &service, std::shared_ptr<TranslationModel> translationModel, std::string &&source,
+                       const ResponseOptions &options, Executor executor, const RequestHandle &handle)
+      : service_(service),
+        translationModel_(std::move(translationModel)),
+        source_(std::move(source)),
+        options_(options),
+        executor_(std::move(executor)),
+        handle_(handle) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> awaiting) {
+    // The callback can run before translate(...) returns, when served from cache or rejected, and resuming may free
+    // this awaitable along with the coroutine frame: nothing here may be touched after, which includes the arguments
+    // translate(...) is still holding on to.
+    auto callback = [this, awaiting](Response &&response) {
+      response_ = std::move(response);
+      if (executor_) {
+        executor_([awaiting]() { awaiting.resume(); });
+      } else {
+        awaiting.resume();
+      }
+    };
+    AsyncService &service = service_;
+    std::shared_ptr<TranslationModel> translationModel = translationModel_;
+    std::string source = std::move(source_);
+    ResponseOptions options = options_;
+    RequestHandle handle = handle_;
+    service.translateWithHandle(std::move(translationModel), std::move(source), callback, options, handle);
+  }
+
+  Response await_resume() { return std::move(response_); }
+
+ private:
+  AsyncService &service_;
+  std::shared_ptr<TranslationModel> translationModel_;
+  std::string source_;
+  ResponseOptions options_;
+  Executor executor_;
+  RequestHandle handle_;
+  Response response_;
+};
+
+inline TranslationAwaitable AsyncService::translateAwaitable(std::shared_ptr<TranslationModel> translationModel,
+                                                             std::string &&source, const ResponseOptions &options,
+                                                             Executor executor, const RequestHandle &handle) {
+  return TranslationAwaitable(*this, std::move(translationModel), std::move(source), options, std::move(executor),
+                              handle);
+}
+#endif
+
 }  // namespace bergamot
 }  // namespace marian
 
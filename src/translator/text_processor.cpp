@@ -63,7 +63,14 @@ TextProcessor::TextProcessor(Ptr<Options> options, const Vocabs &vocabs, const s
 }
 
 TextProcessor::TextProcessor(Ptr<Options> options, const Vocabs &vocabs, const AlignedMemory &memory)
-    : vocabs_(vocabs) {
+    : TextProcessor(options, vocabs, loadSentenceSplitter(options, memory)) {}
+
+TextProcessor::TextProcessor(Ptr<Options> options, const Vocabs &vocabs, ug::ssplit::SentenceSplitter &&splitter)
+    : vocabs_(vocabs), ssplit_(std::move(splitter)) {
+  parseCommonOptions(options);
+}
+
+ug::ssplit::SentenceSplitter TextProcessor::loadSentenceSplitter(Ptr<Options> options, const AlignedMemory &memory) {
   // This is not the best of the solutions at the moment, but is consistent with what happens among other structures
   // like model, vocabulary or shortlist. First, we check if the bytearray is empty. If not, we load from ByteArray. In
   // case empty, the string based loader which reads from file is called. However, ssplit allows for not supplying
@@ -71,12 +78,10 @@ TextProcessor::TextProcessor(Ptr<Options> options, const Vocabs &vocabs, const A
   //
   // For now, we allow not supplying an ssplit-prefix-file.
 
-  if (memory.begin() == nullptr && memory.size()) {
-    ssplit_ = loadSplitter(memory);
-  } else {
-    ssplit_ = loadSplitter(options->get<std::string>("ssplit-prefix-file", ""));
+  if (memory.begin() != nullptr && memory.size()) {
+    return loadSplitter(memory);
   }
-  parseCommonOptions(options);
+  return loadSplitter(options->get<std::string>("ssplit-prefix-file", ""));
 }
 
 void TextProcessor::parseCommonOptions(Ptr<Options> options) {
@@ -41,6 +41,13 @@ class TextProcessor {
   /// @param [in] memory: ssplit-prefix-file contents in memory, passed as a bytearray.
   TextProcessor(Ptr<Options>, const Vocabs &vocabs, const AlignedMemory &memory);
 
+  /// Construct TextProcessor from options, vocabs and a sentence-splitter loaded ahead with loadSentenceSplitter(...),
+  /// e.g. concurrently with the vocabs.
+  TextProcessor(Ptr<Options>, const Vocabs &vocabs, ug::ssplit::SentenceSplitter &&splitter);
+
+  /// Loads the sentence-splitter of the memory based constructor, from memory or if empty from `ssplit-prefix-file`.
+  static ug::ssplit::SentenceSplitter loadSentenceSplitter(Ptr<Options> options, const AlignedMemory &memory);
+
   /// Wrap into sentences of at most maxLengthBreak_ tokens and add to source.
   /// @param [in] blob: Input blob, will be bound to source and annotations on it stored.
   /// @param [out] source: AnnotatedText instance holding input and annotations of sentences and pieces
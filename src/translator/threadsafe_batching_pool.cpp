@@ -1,4 +1,3 @@
-
 #ifndef SRC_BERGAMOT_THREADSAFE_BATCHING_POOL_IMPL
 #error "This is an impl file and must not be included directly!"
 #endif
@@ -11,7 +10,14 @@ namespace bergamot {
 template <class BatchingPoolType>
 template <class... Args>
 ThreadsafeBatchingPool<BatchingPoolType>::ThreadsafeBatchingPool(Args &&...args)
-    : backend_(std::forward<Args>(args)...), enqueued_(0), shutdown_(false) {}
+    : backend_(std::forward<Args>(args)...),
+      intake_(kIntakeCapacity),
+      enqueued_(0),
+      shutdown_(false),
+      fillWords_(0),
+      maxWait_(0),
+      generation_(0),
+      idle_(0) {}
 
 template <class BatchingPoolType>
 ThreadsafeBatchingPool<BatchingPoolType>::~ThreadsafeBatchingPool() {
@@ -21,35 +27,203 @@ ThreadsafeBatchingPool<BatchingPoolType>::~ThreadsafeBatchingPool() {
 template <class BatchingPoolType>
 template <class... Args>
 void ThreadsafeBatchingPool<BatchingPoolType>::enqueueRequest(Args &&...args) {
-  std::unique_lock<std::mutex> lock(mutex_);
   assert(!shutdown_);
-  enqueued_ += backend_.enqueueRequest(std::forward<Args>(args)...);
-  work_.notify_all();
+  Intake intake = [args...](BatchingPoolType &backend) { return backend.enqueueRequest(args...); };
+  if (!intake_.tryPush(std::move(intake))) {
+    // Intake is full, consumers are behind. Enqueue directly, after what is already in intake to keep order.
+    std::unique_lock<std::mutex> lock(mutex_);
+    drainIntake();
+    enqueued_ += backend_.enqueueRequest(std::forward<Args>(args)...);
+  }
+
+  // Pairs with the fence in generateBatch(...): either a consumer counted in idle_ is signaled, or it finds the request
+  // when it drains intake_.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (idle_.load(std::memory_order_relaxed) > 0) {
+    wakeConsumers();
+  }
+}
+
+template <class BatchingPoolType>
+template <class... Args>
+bool ThreadsafeBatchingPool<BatchingPoolType>::tryEnqueueRequest(std::chrono::microseconds timeout, Args &&...args) {
+  RequestSentences cancelled;
+  bool admitted = false;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    drainIntake();
+    // Sentences of requests cancelled while waiting make room as well.
+    auto admits = [&]() {
+      backend_.dropCancelled();
+      return shutdown_ || backend_.admits(args...);
+    };
+    admitted = space_.wait_for(lock, timeout, admits) && !shutdown_;
+    cancelled = takeCancelled();
+
+    if (admitted) {
+      enqueued_ += backend_.enqueueRequest(std::forward<Args>(args)...);
+    }
+  }
+
+  completeCancelled(cancelled);
+  if (admitted) {
+    wakeConsumers();
+  }
+  return admitted;
+}
+
+template <class BatchingPoolType>
+template <class... Args>
+auto ThreadsafeBatchingPool<BatchingPoolType>::pendingStats(Args &&...args) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  drainIntake();
+  RequestSentences cancelled = takeCancelled();
+  auto stats = backend_.pendingStats(std::forward<Args>(args)...);
+  lock.unlock();
+  completeCancelled(cancelled);
+  return stats;
+}
+
+template <class BatchingPoolType>
+void ThreadsafeBatchingPool<BatchingPoolType>::drainIntake() {
+  Intake intake;
+  while (intake_.tryPop(intake)) {
+    enqueued_ += intake(backend_);
+  }
+}
+
+template <class BatchingPoolType>
+RequestSentences ThreadsafeBatchingPool<BatchingPoolType>::takeCancelled() {
+  backend_.dropCancelled();
+  RequestSentences cancelled;
+  backend_.takeCancelled(cancelled);
+  if (!cancelled.empty()) {
+    enqueued_ -= cancelled.size();
+    space_.notify_all();
+  }
+  return cancelled;
+}
+
+template <class BatchingPoolType>
+void ThreadsafeBatchingPool<BatchingPoolType>::completeCancelled(RequestSentences &cancelled) {
+  for (RequestSentence &sentence : cancelled) {
+    sentence.completeSentence(/*history=*/nullptr);
+  }
+}
+
+template <class BatchingPoolType>
+void ThreadsafeBatchingPool<BatchingPoolType>::wakeConsumers() {
+  {
+    std::lock_guard<std::mutex> sleepLock(sleepMutex_);
+    generation_.fetch_add(1);
+  }
+  wakeup_.notify_all();
 }
 
 template <class BatchingPoolType>
 void ThreadsafeBatchingPool<BatchingPoolType>::clear() {
   std::unique_lock<std::mutex> lock(mutex_);
+  drainIntake();
   backend_.clear();
   enqueued_ = 0;
+  space_.notify_all();
+}
+
+template <class BatchingPoolType>
+void ThreadsafeBatchingPool<BatchingPoolType>::setAccumulation(size_t fillWords, std::chrono::microseconds maxWait) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    fillWords_ = fillWords;
+    maxWait_ = maxWait;
+  }
+  wakeConsumers();
 }
 
 template <class BatchingPoolType>
 void ThreadsafeBatchingPool<BatchingPoolType>::shutdown() {
-  std::unique_lock<std::mutex> lock(mutex_);
-  shutdown_ = true;
-  work_.notify_all();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    shutdown_ = true;
+    space_.notify_all();
+  }
+  wakeConsumers();
 }
 
 template <class BatchingPoolType>
 template <class... Args>
 size_t ThreadsafeBatchingPool<BatchingPoolType>::generateBatch(Args &&...args) {
-  std::unique_lock<std::mutex> lock(mutex_);
-  work_.wait(lock, [this]() { return enqueued_ || shutdown_; });
-  size_t sentencesInBatch = backend_.generateBatch(std::forward<Args>(args)...);
-  assert(sentencesInBatch > 0 || shutdown_);
-  enqueued_ -= sentencesInBatch;
-  return sentencesInBatch;
+  using Clock = std::chrono::steady_clock;
+  while (true) {
+    // Count in idle_ before looking for work, see enqueueRequest(...). Any signal from here on moves generation_ past
+    // what is read here, so that the consumer does not go to sleep on a change it has not seen.
+    idle_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    size_t generation = generation_.load();
+    Clock::time_point wakeBy = Clock::time_point::max();
+
+    // Completion of cancelled sentences can trigger client callbacks, which must not run with the lock held. Anything
+    // enqueued while completing moves generation_ on, so that the consumer does not sleep through it after.
+    RequestSentences cancelled;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      drainIntake();
+      cancelled = takeCancelled();
+
+      bool ready = enqueued_ > 0 || shutdown_;
+      if (ready && !shutdown_ && fillWords_ > 0 && backend_.pendingWords() < fillWords_) {
+        // Hold off for more work to accumulate, for as long as the oldest work pending has waited less than maxWait_
+        // since it was produced, whether it was left behind by the last batch or came in since.
+        Clock::time_point oldest = backend_.oldestArrival();
+        if (oldest != Clock::time_point::max() && Clock::now() < oldest + maxWait_) {
+          ready = false;
+          wakeBy = oldest + maxWait_;
+        }
+      }
+
+      if (ready) {
+        size_t sentencesInBatch = backend_.generateBatch(std::forward<Args>(args)...);
+
+        // Sentences of expired requests come up while batching.
+        RequestSentences expired = takeCancelled();
+        cancelled.insert(cancelled.end(), expired.begin(), expired.end());
+
+        if (sentencesInBatch > 0 || shutdown_) {
+          enqueued_ -= sentencesInBatch;
+          if (sentencesInBatch > 0) {
+            space_.notify_all();
+          }
+          idle_.fetch_sub(1, std::memory_order_relaxed);
+          lock.unlock();
+          completeCancelled(cancelled);
+          return sentencesInBatch;
+        }
+
+        // There is pending work, but none that can be batched until a batch in progress is released.
+      }
+    }
+
+    completeCancelled(cancelled);
+    {
+      std::unique_lock<std::mutex> sleepLock(sleepMutex_);
+      auto signaled = [this, generation]() { return generation_.load() != generation; };
+      if (wakeBy == Clock::time_point::max()) {
+        wakeup_.wait(sleepLock, signaled);
+      } else {
+        wakeup_.wait_until(sleepLock, wakeBy, signaled);
+      }
+    }
+    idle_.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+template <class BatchingPoolType>
+template <class... Args>
+void ThreadsafeBatchingPool<BatchingPoolType>::releaseBatch(Args &&...args) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    backend_.releaseBatch(std::forward<Args>(args)...);
+  }
+  wakeConsumers();
 }
 
 }  // namespace bergamot
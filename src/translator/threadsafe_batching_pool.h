@@ -2,11 +2,15 @@
 #ifndef SRC_BERGAMOT_THREADSAFE_BATCHING_POOL_H_
 #define SRC_BERGAMOT_THREADSAFE_BATCHING_POOL_H_
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
 
 #include "aggregate_batching_pool.h"
 #include "batching_pool.h"
+#include "bounded_queue.h"
 #include "common/options.h"
 #include "definitions.h"
 #include "translation_model.h"
@@ -17,9 +21,14 @@ namespace bergamot {
 /// The following mechanism operates in a multithreaded async-workflow guarding access to the pushes to the structure
 /// keeping sentences bucketed by length and sorted by priority.
 ///
-/// This is a wrap of a producer-consumer queue implemented as a monitor, where there is a mutex guarding the
-/// underlying data structure (BatchingPoolType) and (worker/consumer) threads waiting on a condition variable and the
-/// queuing thread producing and notifying waiting threads (consumers) through the same condition variable.
+/// This is a producer-consumer queue. The underlying data structure (BatchingPoolType) is guarded by a mutex, which is
+/// only taken by (worker/consumer) threads generating batches. Producers do not take this mutex: they hand requests
+/// over through a lock-free intake queue, which consumers drain into BatchingPoolType before generating a batch. A
+/// producer never waits on consumers forming batches, except when the intake is full and it falls back to enqueueing
+/// under the mutex.
+///
+/// Consumers with nothing to do sleep on a separate condition variable, which producers signal only when there are
+/// consumers not busy translating, keeping the cost of an enqueue low while workers are saturated.
 ///
 /// Originally written by for a single model (where items are produce: Request, consume: Batch), converted to
 /// also work for multiple models where items are produce: (TranslationModel, Request), consume: (TranlsationModel,
@@ -28,7 +37,23 @@ namespace bergamot {
 /// Requires BatchingPoolType to implement the following:
 ///
 /// * produce: `size_t enqueueRequest(...)` (returns number elements produced)
-/// * consume: `size_t generateBatch(...)` (returns number of elements available to be consumed)
+/// * consume: `size_t generateBatch(...)` (returns number of elements available to be consumed, which can be 0 with
+///   elements pending if none can be consumed until a batch is released)
+/// * release: `void releaseBatch(...)` (accounts for a consumed batch having been processed)
+/// * `size_t pendingWords()` (returns number of words waiting to be consumed)
+/// * `std::chrono::steady_clock::time_point oldestArrival()` (returns when the element waiting longest was produced)
+/// * `void dropCancelled()` (removes elements of requests cancelled since last called, so that they no longer count as
+///   waiting to be consumed)
+/// * `void takeCancelled(RequestSentences&)` (hands over elements of cancelled or expired requests removed on consume
+///   or by `dropCancelled()`, which are completed here without the lock held)
+///
+/// Sentences of cancelled requests are dropped whenever pending work is looked at: before batching, before waiting
+/// for more work to accumulate, on admission and for queue gauges. They are completed right after, so that they
+/// neither hold on to admission budget nor count towards accumulation, and their callbacks do not wait on other work.
+///
+/// Admission control through `tryEnqueueRequest(...)` additionally requires `bool admits(...)` taking the same
+/// arguments as `enqueueRequest(...)`, and queue gauges through `pendingStats(...)` require the same of the backend.
+/// Both take the mutex, as they need an up to date view of pending work.
 
 template <class BatchingPoolType>
 class ThreadsafeBatchingPool {
@@ -40,31 +65,81 @@ class ThreadsafeBatchingPool {
   template <class... Args>
   void enqueueRequest(Args &&...args);
 
+  // Enqueues if the backend admits the request, waiting up to timeout for pending work to be consumed to make room.
+  // Returns false without enqueueing if the request is not admitted in time, or the pool is shutting down.
+  template <class... Args>
+  bool tryEnqueueRequest(std::chrono::microseconds timeout, Args &&...args);
+
+  // Account of pending work as reported by backend, taken under lock.
+  template <class... Args>
+  auto pendingStats(Args &&...args);
+
   template <class... Args>
   size_t generateBatch(Args &&...args);
 
+  template <class... Args>
+  void releaseBatch(Args &&...args);
+
   // Removes any pending requests from the batching pool.
   void clear();
 
+  // Makes consumers hold off on generating a batch until at least `fillWords` words are pending, or the oldest pending
+  // work has been waiting for `maxWait` since it was produced, whichever comes first. A `fillWords` of 0 (default)
+  // generates batches from whatever is pending as soon as a consumer is available.
+  void setAccumulation(size_t fillWords, std::chrono::microseconds maxWait);
+
   // Signals shut down of batching pool. After this no new requests can be enqueued,
   // but all enqueued requests will be processed. To prevent this from happening,
   // call `clear()` before `shutdown()`.
   void shutdown();
 
  private:
+  // A request handed over by a producer, to be enqueued into backend_ by a consumer.
+  using Intake = std::function<size_t(BatchingPoolType &)>;
+
+  // Capacity of intake_. Producers fall back to enqueueing under the lock if it fills up.
+  static constexpr size_t kIntakeCapacity = 1024;
+
+  // Moves requests from intake_ into backend_. Requires the lock to be held.
+  void drainIntake();
+
+  // Drops sentences of cancelled requests from backend_ and takes them out of the account of pending work, to be
+  // completed with completeCancelled(...) once the lock is released. Requires the lock to be held.
+  RequestSentences takeCancelled();
+
+  // Completes sentences taken with takeCancelled(), which can trigger client callbacks. Requires the lock not be held.
+  static void completeCancelled(RequestSentences &cancelled);
+
+  // Wakes up consumers sleeping for something to change.
+  void wakeConsumers();
+
   BatchingPoolType backend_;
 
+  BoundedQueue<Intake> intake_;
+
   // Number of sentences in backend_;
   size_t enqueued_;
 
   // Are we shutting down?
-  bool shutdown_;
+  std::atomic<bool> shutdown_;
 
-  // Lock on this object.
+  // Accumulation policy, see setAccumulation(...).
+  size_t fillWords_;
+  std::chrono::microseconds maxWait_;
+
+  // Lock on backend_ and the state accompanying it.
   std::mutex mutex_;
 
-  // Signaled when there are sentences to translate.
-  std::condition_variable work_;
+  // Signaled when pending sentences are consumed, for producers waiting on admission.
+  std::condition_variable space_;
+
+  // Consumers sleep on wakeup_ until generation_ moves on, which happens on anything that could allow a consumer to
+  // make progress: requests enqueued, a batch released, shut down. Consumers count themselves in idle_ while in
+  // generateBatch(...), so that producers can skip signaling when every consumer is busy translating.
+  std::mutex sleepMutex_;
+  std::condition_variable wakeup_;
+  std::atomic<size_t> generation_;
+  std::atomic<size_t> idle_;
 };
 
 }  // namespace bergamot
@@ -1,5 +1,8 @@
 #include "translation_model.h"
 
+#include <chrono>
+#include <unordered_set>
+
 #include "batch.h"
 #include "byte_array_util.h"
 #include "cache.h"
@@ -16,37 +19,131 @@ namespace bergamot {
 
 std::atomic<size_t> TranslationModel::modelCounter_ = 0;
 
+namespace {
+
+size_t bundleBytes(const MemoryBundle &memory) {
+  size_t bytes = memory.model.size() + memory.shortlist.size() + memory.ssplitPrefixFile.size() +
+                 memory.qualityEstimatorMemory.size();
+  std::unordered_set<const AlignedMemory *> vocabs;
+  for (const std::shared_ptr<AlignedMemory> &vocab : memory.vocabs) {
+    if (vocab && vocabs.insert(vocab.get()).second) {
+      bytes += vocab->size();
+    }
+  }
+  return bytes;
+}
+
+// Translated by warmup(...). Short, to keep warm up quick, but a sentence nonetheless so that every stage is exercised.
+constexpr const char *kWarmupText = "This is a sentence to warm up with.";
+
+}  // namespace
+
 TranslationModel::TranslationModel(const Config &options, MemoryBundle &&memory /*=MemoryBundle{}*/)
+    : TranslationModel(options, loadComponents(options, std::move(memory), /*concurrently=*/false)) {}
+
+TranslationModel::TranslationModel(const Config &options, Components &&components)
     : modelId_(modelCounter_++),
       options_(options),
-      memory_(std::move(memory)),
-      vocabs_(options, std::move(memory_.vocabs)),
-      textProcessor_(options, vocabs_, std::move(memory_.ssplitPrefixFile)),
+      schedulingWeight_(options->get<float>("scheduling-weight", 1.0f)),
+      maxActiveBatches_(options->get<size_t>("max-active-batches", 0)),
+      bundleBytes_(components.bundleBytes),
+      memory_(std::move(components.memory)),
+      vocabs_(std::move(components.vocabs)),
+      textProcessor_(options, vocabs_, std::move(components.splitter)),
       batchingPool_(options),
-      qualityEstimator_(createQualityEstimator(getQualityEstimatorModel(memory, options))) {
-
-  // Try to load shortlist from memory-bundle. If not available, try to load from options_;
-
-  int srcIdx = 0, trgIdx = 1;
-  // vocabs_->sources().front() is invoked as we currently only support one source vocab
-  bool shared_vcb = (vocabs_.sources().front() == vocabs_.target());
-
-  if (memory_.shortlist.size() > 0 && memory_.shortlist.begin() != nullptr) {
-    bool check = options_->get<bool>("check-bytearray", false);
-    shortlistGenerator_ = New<data::BinaryShortlistGenerator>(memory_.shortlist.begin(), memory_.shortlist.size(),
-                                                              vocabs_.sources().front(), vocabs_.target(), srcIdx,
-                                                              trgIdx, shared_vcb, check);
-  } else if (options_->hasAndNotEmpty("shortlist")) {
-    // Changed to BinaryShortlistGenerator to enable loading binary shortlist file
-    // This class also supports text shortlist file
-    shortlistGenerator_ = New<data::BinaryShortlistGenerator>(options_, vocabs_.sources().front(), vocabs_.target(),
-                                                              srcIdx, trgIdx, shared_vcb);
-  } else {
-    // In this case, the loadpath does not load shortlist.
-    shortlistGenerator_ = nullptr;
+      shortlistGenerator_(std::move(components.shortlistGenerator)),
+      qualityEstimator_(std::move(components.qualityEstimator)) {
+  ABORT_IF(schedulingWeight_ <= 0, "scheduling-weight should be positive, got {}", schedulingWeight_);
+
+  if (memory_.model.size() == 0 || memory_.model.begin() == nullptr) {
+    for (const std::string &model : options_->get<std::vector<std::string>>("models")) {
+      replicaParameterBytes_ += filesystem::fileSize(model);
+    }
   }
 }
 
+std::future<std::unique_ptr<TranslationModel>> TranslationModel::loadAsync(const Config &options,
+                                                                           MemoryBundle &&memory) {
+  return std::async(std::launch::async, [options, memory = std::move(memory)]() mutable {
+    Components components = loadComponents(options, std::move(memory), /*concurrently=*/true);
+    return std::unique_ptr<TranslationModel>(new TranslationModel(options, std::move(components)));
+  });
+}
+
+std::future<std::unique_ptr<TranslationModel>> TranslationModel::loadAsync(const Config &options) {
+  return std::async(std::launch::async, [options]() {
+    MemoryBundle memory = getMemoryBundleFromConfig(options, /*concurrently=*/true);
+    Components components = loadComponents(options, std::move(memory), /*concurrently=*/true);
+    return std::unique_ptr<TranslationModel>(new TranslationModel(options, std::move(components)));
+  });
+}
+
+TranslationModel::Components TranslationModel::loadComponents(const Config &options, MemoryBundle &&memory,
+                                                              bool concurrently) {
+  // Deferred tasks run on the calling thread when their result is asked for, in the order below. Tasks use distinct
+  // members of memory, which is moved from only once all are done.
+  std::launch policy = concurrently ? std::launch::async : std::launch::deferred;
+  size_t bytes = bundleBytes(memory);
+
+  // Replicas of the backend all map their parameters from memory.model, which is checked once here for all of them.
+  auto validated = std::async(policy, [&options, &memory]() {
+    if (memory.model.size() > 0 && memory.model.begin() != nullptr) {
+      ABORT_IF((uintptr_t)memory.model.begin() % 256 != 0,
+               "The provided memory is not aligned to 256 bytes and will crash when vector instructions are used on "
+               "it.");
+      if (options->get<bool>("check-bytearray", false)) {
+        ABORT_IF(!validateBinaryModel(memory.model, memory.model.size()),
+                 "The binary file is invalid. Incomplete or corrupted download?");
+      }
+    }
+  });
+
+  std::shared_future<Vocabs> vocabs = std::async(policy, [&options, &memory, concurrently]() {
+                                        return Vocabs(options, std::move(memory.vocabs), concurrently);
+                                      }).share();
+
+  auto splitter = std::async(
+      policy, [&options, &memory]() { return TextProcessor::loadSentenceSplitter(options, memory.ssplitPrefixFile); });
+
+  // Try to load shortlist from memory-bundle. If not available, try to load from options.
+  auto shortlistGenerator = std::async(policy, [&options, &memory, vocabs]() -> ShortlistGenerator {
+    int srcIdx = 0, trgIdx = 1;
+    // vocabs.sources().front() is invoked as we currently only support one source vocab
+    const Vocabs &loaded = vocabs.get();
+    bool shared_vcb = (loaded.sources().front() == loaded.target());
+
+    if (memory.shortlist.size() > 0 && memory.shortlist.begin() != nullptr) {
+      bool check = options->get<bool>("check-bytearray", false);
+      return New<data::BinaryShortlistGenerator>(memory.shortlist.begin(), memory.shortlist.size(),
+                                                 loaded.sources().front(), loaded.target(), srcIdx, trgIdx, shared_vcb,
+                                                 check);
+    } else if (options->hasAndNotEmpty("shortlist")) {
+      // Changed to BinaryShortlistGenerator to enable loading binary shortlist file
+      // This class also supports text shortlist file
+      return New<data::BinaryShortlistGenerator>(options, loaded.sources().front(), loaded.target(), srcIdx, trgIdx,
+                                                 shared_vcb);
+    } else {
+      // In this case, the loadpath does not load shortlist.
+      return nullptr;
+    }
+  });
+
+  auto qualityEstimator = std::async(
+      policy, [&options, &memory]() { return createQualityEstimator(getQualityEstimatorModel(memory, options)); });
+
+  validated.get();
+  Vocabs loadedVocabs = vocabs.get();
+  ug::ssplit::SentenceSplitter loadedSplitter = splitter.get();
+  ShortlistGenerator loadedShortlistGenerator = shortlistGenerator.get();
+  std::shared_ptr<QualityEstimator> loadedQualityEstimator = qualityEstimator.get();
+  return Components{bytes,
+                    std::move(memory),
+                    std::move(loadedVocabs),
+                    std::move(loadedSplitter),
+                    std::move(loadedShortlistGenerator),
+                    std::move(loadedQualityEstimator)};
+}
+
 void TranslationModel::loadBackend(MarianBackend &backend, Workspace &workspace) {
   auto &graph = backend.graph;
   auto &scorerEnsemble = backend.scorerEnsemble;
@@ -65,13 +162,8 @@ void TranslationModel::loadBackend(MarianBackend &backend, Workspace &workspace)
   if (memory_.model.size() > 0 &&
       memory_.model.begin() !=
           nullptr) {  // If we have provided a byte array that contains the model memory, we can initialise the
-                      // model from there, as opposed to from reading in the config file
-    ABORT_IF((uintptr_t)memory_.model.begin() % 256 != 0,
-             "The provided memory is not aligned to 256 bytes and will crash when vector instructions are used on it.");
-    if (options_->get<bool>("check-bytearray", false)) {
-      ABORT_IF(!validateBinaryModel(memory_.model, memory_.model.size()),
-               "The binary file is invalid. Incomplete or corrupted download?");
-    }
+                      // model from there, as opposed to from reading in the config file. Parameters are then mapped
+                      // from the byte array, shared by the graphs of all replicas, with only activations in workspace.
     const std::vector<const void *> container = {
         memory_.model.begin()};  // Marian supports multiple models initialised in this manner hence std::vector.
                                  // However we will only ever use 1 during decoding.
@@ -92,38 +184,96 @@ void TranslationModel::loadBackend(MarianBackend &backend, Workspace &workspace)
 // Make request process is shared between Async and Blocking workflow of translating.
 Ptr<Request> TranslationModel::makeRequest(size_t requestId, std::string &&source, CallbackType callback,
                                            const ResponseOptions &responseOptions,
-                                           std::optional<TranslationCache> &cache) {
+                                           std::optional<TranslationCache> &cache, const RequestHandle &handle,
+                                           const Executor &completer) {
   Segments segments;
   AnnotatedText annotatedSource;
 
   textProcessor_.process(std::move(source), annotatedSource, segments);
   ResponseBuilder responseBuilder(responseOptions, std::move(annotatedSource), vocabs_, callback, *qualityEstimator_);
 
-  Ptr<Request> request =
-      New<Request>(requestId, /*model=*/*this, std::move(segments), std::move(responseBuilder), cache);
+  Ptr<Request> request = New<Request>(requestId, /*model=*/shared_from_this(), std::move(segments),
+                                      std::move(responseBuilder), responseOptions, cache, handle, completer);
+  request->completePrefilled();
   return request;
 }
 
 Ptr<Request> TranslationModel::makePivotRequest(size_t requestId, AnnotatedText &&previousTarget, CallbackType callback,
                                                 const ResponseOptions &responseOptions,
-                                                std::optional<TranslationCache> &cache) {
+                                                std::optional<TranslationCache> &cache, const RequestHandle &handle,
+                                                const Executor &completer) {
   Segments segments;
 
   textProcessor_.processFromAnnotation(previousTarget, segments);
   ResponseBuilder responseBuilder(responseOptions, std::move(previousTarget), vocabs_, callback, *qualityEstimator_);
 
-  Ptr<Request> request = New<Request>(requestId, *this, std::move(segments), std::move(responseBuilder), cache);
+  Ptr<Request> request = New<Request>(requestId, /*model=*/shared_from_this(), std::move(segments),
+                                      std::move(responseBuilder), responseOptions, cache, handle, completer);
+  request->completePrefilled();
   return request;
 }
 
+TranslationModel::MarianBackend &TranslationModel::backend(Workspace &workspace) {
+  // The container backend_ can be operated by multiple workers at a time. Elements stay put as others are inserted or
+  // erased, so the replica can be used outside the lock. Only the worker owning workspace uses its replica, so loading
+  // it needs no lock either.
+  MarianBackend *replica = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(backendMutex_);
+    replica = &backend_[workspace.id()];
+  }
+
+  if (!replica->initialized) {
+    loadBackend(*replica, workspace);
+    replica->initialized = true;
+    workspace.addReplica(weak_from_this());
+  }
+  return *replica;
+}
+
+void TranslationModel::warmup(Workspace &workspace, bool translate) {
+  MarianBackend &replica = backend(workspace);
+  if (!translate) {
+    return;
+  }
+
+  // Goes through the same preprocessing and search as any other text, but the result is of no interest.
+  Segments segments;
+  AnnotatedText annotatedSource;
+  textProcessor_.process(std::string(kWarmupText), annotatedSource, segments);
+  if (segments.empty()) {
+    return;
+  }
+
+  workspace.clear();
+  BeamSearch search(options_, replica.scorerEnsemble, vocabs_.target());
+  search.search(replica.graph, convertToMarianBatch(segments));
+}
+
+size_t TranslationModel::residentBytes() {
+  std::lock_guard<std::mutex> guard(backendMutex_);
+  return bundleBytes_ + backend_.size() * replicaParameterBytes_;
+}
+
+void TranslationModel::releaseBackend(size_t deviceId) {
+  std::lock_guard<std::mutex> guard(backendMutex_);
+  backend_.erase(deviceId);
+}
+
 Ptr<marian::data::CorpusBatch> TranslationModel::convertToMarianBatch(Batch &batch) {
+  Segments segments;
+  for (auto &sentence : batch.sentences()) {
+    segments.push_back(sentence.getUnderlyingSegment());
+  }
+  return convertToMarianBatch(segments);
+}
+
+Ptr<marian::data::CorpusBatch> TranslationModel::convertToMarianBatch(const Segments &segments) {
   std::vector<data::SentenceTuple> batchVector;
-  auto &sentences = batch.sentences();
 
   size_t batchSequenceNumber{0};
-  for (auto &sentence : sentences) {
+  for (auto &segment : segments) {
     data::SentenceTuple sentence_tuple(batchSequenceNumber);
-    Segment segment = sentence.getUnderlyingSegment();
     sentence_tuple.push_back(segment);
     batchVector.push_back(sentence_tuple);
 
@@ -192,22 +342,54 @@ void TranslationModel::translateBatch(Workspace &workspace, Batch &batch) {
   workspace.clear();
 
   // Create backend if not exists, for device. Dynamically.
-  size_t deviceId = workspace.id();
+  MarianBackend &replica = backend(workspace);
+  BeamSearch search(options_, replica.scorerEnsemble, vocabs_.target());
+  auto start = std::chrono::steady_clock::now();
+  Histories histories = search.search(replica.graph, convertToMarianBatch(batch));
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  // Learn output lengths for packing subsequent batches, and keep account of how well this one was packed.
+  BatchStats stats;
+  size_t longestSource = 0, longestTarget = 0;
+  for (size_t i = 0; i < histories.size(); i++) {
+    size_t sourceLength = batch.sentences()[i].numTokens();
+    size_t targetLength = std::get<0>(histories[i]->top()).size();
+    batchingPool_.outputLength().observe(sourceLength, targetLength);
+
+    stats.sourceTokens += sourceLength;
+    stats.decodeSteps += targetLength;
+    longestSource = std::max(longestSource, sourceLength);
+    longestTarget = std::max(longestTarget, targetLength);
+  }
+  stats.batches = 1;
+  stats.sentences = histories.size();
+  stats.paddedSourceTokens = stats.sentences * longestSource;
+  stats.paddedDecodeSteps = stats.sentences * longestTarget;
+  LOG(debug, "Batch(sentences={}, padding={:.3f}, wasted-steps={:.3f})", stats.sentences, stats.padding(),
+      stats.wastedSteps());
+
+  MiniBatchWordsTuner &miniBatchWords = batchingPool_.miniBatchWords();
+  if (miniBatchWords.observe(stats.sourceTokens, stats.paddedSourceTokens, elapsed)) {
+    LOG(info, "Auto-tuned mini-batch-words for model {} converged at {}", modelId_, miniBatchWords.value());
+  }
+
   {
-    // The container backend_ can be operated by multiple workers at a time.
-    std::lock_guard<std::mutex> guard(backendMutex_);
-    auto p = backend_.find(deviceId);
-    if (p == backend_.end()) {
-      backend_[deviceId] = MarianBackend{};
-      loadBackend(backend_[deviceId], workspace);
-    }
+    std::lock_guard<std::mutex> guard(batchStatsMutex_);
+    batchStats_.batches += stats.batches;
+    batchStats_.sentences += stats.sentences;
+    batchStats_.sourceTokens += stats.sourceTokens;
+    batchStats_.paddedSourceTokens += stats.paddedSourceTokens;
+    batchStats_.decodeSteps += stats.decodeSteps;
+    batchStats_.paddedDecodeSteps += stats.paddedDecodeSteps;
   }
 
-  auto &backend = backend_[deviceId];
-  BeamSearch search(options_, backend.scorerEnsemble, vocabs_.target());
-  Histories histories = search.search(backend.graph, convertToMarianBatch(batch));
   batch.completeBatch(histories);
 }
 
+TranslationModel::BatchStats TranslationModel::batchStats() const {
+  std::lock_guard<std::mutex> guard(batchStatsMutex_);
+  return batchStats_;
+}
+
 }  // namespace bergamot
 }  // namespace marian
@@ -1,6 +1,8 @@
 #ifndef SRC_BERGAMOT_TRANSLATION_MODEL_H_
 #define SRC_BERGAMOT_TRANSLATION_MODEL_H_
 
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -29,12 +31,35 @@ class Workspace;
 ///
 /// Thread-safety is not handled here, but the methods are available at granularity enough to be used in threaded async
 /// workflow for translation.
+///
+/// A TranslationModel is to be owned through a shared pointer: each Request made from it shares its ownership until
+/// the Response is built, so that releasing a model with translations in flight is safe.
 
-class TranslationModel {
+class TranslationModel : public std::enable_shared_from_this<TranslationModel> {
  public:
   using Config = Ptr<Options>;
   using ShortlistGenerator = Ptr<data::ShortlistGenerator const>;
 
+  /// Account of batches translated with this model, summed across batches. Padding is the share of source positions
+  /// in batches not holding a token. Wasted steps is the share of decoder steps spent on rows whose translation had
+  /// already finished, i.e. the cost of sentences in a batch not finishing together.
+  struct BatchStats {
+    size_t batches{0};
+    size_t sentences{0};
+    size_t sourceTokens{0};        ///< Tokens in source sentences.
+    size_t paddedSourceTokens{0};  ///< Rows times the longest source, per batch.
+    size_t decodeSteps{0};         ///< Tokens in translations.
+    size_t paddedDecodeSteps{0};   ///< Rows times the longest translation, per batch.
+
+    float padding() const {
+      return paddedSourceTokens > 0 ? 1.0f - static_cast<float>(sourceTokens) / paddedSourceTokens : 0.0f;
+    }
+
+    float wastedSteps() const {
+      return paddedDecodeSteps > 0 ? 1.0f - static_cast<float>(decodeSteps) / paddedDecodeSteps : 0.0f;
+    }
+  };
+
   /// Equivalent to options based constructor, where `options` is parsed from string configuration. Configuration can be
   /// JSON or YAML. Keys expected correspond to those of `marian-decoder`, available at
   /// https://marian-nmt.github.io/docs/cmd/marian-decoder/
@@ -54,7 +79,9 @@ class TranslationModel {
 
   /// Construct TranslationModel from marian-options. If memory is empty, TranslationModel is initialized from
   /// paths available in the options object, backed by filesystem. Otherwise, TranslationModel is initialized from the
-  /// given MemoryBundle composed of AlignedMemory holding equivalent parameters.
+  /// given MemoryBundle composed of AlignedMemory holding equivalent parameters. Parameters held in memory (see
+  /// getModelMemoryFromConfig(...)) are shared by the replicas of the backend for all workers, while parameters loaded
+  /// from the filesystem are copied into each.
   ///
   /// @param [in] options: Marian options object.
   /// @param [in] memory: MemoryBundle object holding memory buffers containing parameters to build MarianBackend,
@@ -63,6 +90,15 @@ class TranslationModel {
 
   TranslationModel(const Config& options) : TranslationModel(options, getMemoryBundleFromConfig(options)) {}
 
+  /// Constructs a TranslationModel on a thread of its own, as the options and memory based constructor does, but with
+  /// independent parts (vocabs, sentence-splitter, shortlist generator, quality estimator, validation of the model)
+  /// loaded concurrently. Loading several models this way at once scales with the number of cores.
+  static std::future<std::unique_ptr<TranslationModel>> loadAsync(const Config& options, MemoryBundle&& memory);
+
+  /// As loadAsync(options, memory), with memory read from the paths in options, a file per thread (see
+  /// getMemoryBundleFromConfig(...)).
+  static std::future<std::unique_ptr<TranslationModel>> loadAsync(const Config& options);
+
   /// Make a Request to be translated by this TranslationModel instance.
   /// @param [in] requestId: Unique identifier associated with this request, available from Service.
   /// @param [in] source: Source text to be translated. Ownership is accepted and eventually returned to the client in
@@ -71,11 +107,15 @@ class TranslationModel {
   /// created Request.
   /// @param [in] responseOptions: Configuration used to prepare the Response corresponding to the created request.
   //  @returns Request created from the query parameters wrapped within a shared-pointer.
+  /// @param [in] handle: Handle through which the client can cancel the request.
+  /// @param [in] completer: Executor to build the Response on, see Request.
   Ptr<Request> makeRequest(size_t requestId, std::string&& source, CallbackType callback,
-                           const ResponseOptions& responseOptions, std::optional<TranslationCache>& cache);
+                           const ResponseOptions& responseOptions, std::optional<TranslationCache>& cache,
+                           const RequestHandle& handle = RequestHandle(), const Executor& completer = nullptr);
 
   Ptr<Request> makePivotRequest(size_t requestId, AnnotatedText&& previousTarget, CallbackType callback,
-                                const ResponseOptions& responseOptions, std::optional<TranslationCache>& cache);
+                                const ResponseOptions& responseOptions, std::optional<TranslationCache>& cache,
+                                const RequestHandle& handle = RequestHandle(), const Executor& completer = nullptr);
 
   /// Relays a request to the batching-pool specific to this translation model.
   /// @param [in] request: Request constructed through makeRequest
@@ -88,6 +128,26 @@ class TranslationModel {
   /// @returns number of sentences that constitute the Batch.
   size_t generateBatch(Batch& batch) { return batchingPool_.generateBatch(batch); }
 
+  /// Drops sentences of requests cancelled since last looked for from the batching-pool for this translation model, so
+  /// that they no longer count as pending. They are set aside for takeCancelled(...).
+  void dropCancelled() { batchingPool_.dropCancelled(); }
+
+  /// Moves sentences of cancelled requests dropped from the batching-pool for this translation model into cancelled.
+  void takeCancelled(RequestSentences& cancelled) { batchingPool_.takeCancelled(cancelled); }
+
+  /// Removes the requests pending in the batching-pool for this translation model, without completing them.
+  void clearPending() { batchingPool_.clear(); }
+
+  /// Number of words in sentences pending translation in the batching-pool for this translation model.
+  size_t pendingWords() const { return batchingPool_.pendingWords(); }
+
+  /// Arrival of the sentence pending longest in the batching-pool for this translation model, see
+  /// BatchingPool::oldestArrival().
+  std::chrono::steady_clock::time_point oldestPendingArrival() { return batchingPool_.oldestArrival(); }
+
+  /// Account of sentences pending translation in the batching-pool for this translation model.
+  const BatchingPool::Stats& pendingStats() const { return batchingPool_.stats(); }
+
   /// Translate a batch generated with generateBatch
   ///
   /// @param [in] deviceId: There are replicas of backend created for use in each worker thread. deviceId indicates
@@ -95,12 +155,62 @@ class TranslationModel {
   /// @param [in] batch: A batch generated from generateBatch from the same TranslationModel instance.
   void translateBatch(Workspace& workspace, Batch& batch);
 
+  /// Creates the replica of the backend for workspace ahead of translateBatch(...), which would otherwise create it on
+  /// first use. Replicas for different workspaces can be created concurrently, each on the thread owning the workspace.
+  ///
+  /// @param [in] workspace: Workspace the replica is for.
+  /// @param [in] translate: Whether to also translate a short dummy text with the replica, to fault in the pages of
+  /// parameters and resolve the kernels to use on this machine. Not accounted in batchStats() or auto-tuning.
+  void warmup(Workspace& workspace, bool translate);
+
+  /// Frees the replica of the backend for the workspace identified by deviceId, as that workspace goes (see
+  /// Workspace::addReplica). The replica is recreated if a workspace with the same id is used again.
+  void releaseBackend(size_t deviceId);
+
+  /// Account of batches translated so far, see BatchStats.
+  BatchStats batchStats() const;
+
+  /// Budget of words in a batch in effect, which is mini-batch-words unless auto-tuned (`autotune-mini-batch-words`).
+  size_t miniBatchWords() { return batchingPool_.miniBatchWords().value(); }
+
+  /// Approximate bytes held by this model: the byte-arrays it was constructed from, and the parameters of replicas of
+  /// the backend which do not map them from memory but hold copies. Workspaces, held by services, are not included.
+  size_t residentBytes();
+
   /// Returns a unique-identifier for the model.
   size_t modelId() const { return modelId_; }
 
+  /// Options the model was constructed with.
+  const Config& options() const { return options_; }
+
+  /// Share of workers this model is entitled to relative to other models served together (`scheduling-weight`).
+  float schedulingWeight() const { return schedulingWeight_; }
+
+  /// Maximum number of batches of this model in translation at the same time (`max-active-batches`), 0 if unlimited.
+  size_t maxActiveBatches() const { return maxActiveBatches_; }
+
  private:
+  /// Parts of a TranslationModel loaded from options and memory ahead of constructing it, see loadComponents(...).
+  struct Components {
+    size_t bundleBytes;
+    MemoryBundle memory;
+    Vocabs vocabs;
+    ug::ssplit::SentenceSplitter splitter;
+    ShortlistGenerator shortlistGenerator;
+    std::shared_ptr<QualityEstimator> qualityEstimator;
+  };
+
+  TranslationModel(const Config& options, Components&& components);
+
+  /// Loads the parts of a TranslationModel which do not depend on each other, each on a thread of its own if
+  /// concurrently, otherwise one after another on the calling thread. The shortlist generator waits on the vocabs.
+  static Components loadComponents(const Config& options, MemoryBundle&& memory, bool concurrently);
+
   size_t modelId_;
   Config options_;
+  float schedulingWeight_;
+  size_t maxActiveBatches_;
+  size_t bundleBytes_;
   MemoryBundle memory_;
   Vocabs vocabs_;
   TextProcessor textProcessor_;
@@ -115,20 +225,31 @@ class TranslationModel {
 
     Graph graph{nullptr};
     ScorerEnsemble scorerEnsemble;
-    bool initialized{false};
+    bool initialized{false};  ///< Whether loaded, by the thread owning the workspace the replica is for.
   };
 
   // ShortlistGenerator is purely const, we don't need one per thread.
   ShortlistGenerator shortlistGenerator_;
 
-  /// Hold replicas of the backend (graph, scorers, shortlist) for use in each thread.
-  /// Controlled and consistent external access via graph(id), scorerEnsemble(id),
+  /// Hold replicas of the backend (graph, scorers, shortlist) for use in each thread. backendMutex_ guards the
+  /// container only, replicas are loaded outside of it so that workers do not wait on each other loading.
   std::mutex backendMutex_;
+
+  /// Bytes of parameters copied into each replica, 0 if replicas map them from memory_.model.
+  size_t replicaParameterBytes_{0};
+
+  BatchStats batchStats_;
+  mutable std::mutex batchStatsMutex_;
   std::unordered_map<size_t, MarianBackend> backend_;
   std::shared_ptr<QualityEstimator> qualityEstimator_;
 
   void loadBackend(MarianBackend& backend, Workspace& workspace);
+
+  /// Replica of the backend for workspace, loaded on first use.
+  MarianBackend& backend(Workspace& workspace);
+
   Ptr<marian::data::CorpusBatch> convertToMarianBatch(Batch& batch);
+  Ptr<marian::data::CorpusBatch> convertToMarianBatch(const Segments& segments);
 
   static std::atomic<size_t> modelCounter_;
 };
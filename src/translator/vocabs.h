@@ -1,5 +1,7 @@
 #pragma once
 
+#include <future>
+
 namespace marian {
 namespace bergamot {
 
@@ -7,15 +9,18 @@ namespace bergamot {
 /// Holds multiple source vocabularies and one target vocabulary
 class Vocabs {
  public:
-  /// Construct vocabs object from either byte-arrays or files
-  Vocabs(Ptr<Options> options, std::vector<std::shared_ptr<AlignedMemory>>&& vocabMemories) : options_(options) {
+  /// Construct vocabs object from either byte-arrays or files. If concurrently, distinct vocabularies (e.g. separate
+  /// source and target) are loaded on threads of their own, otherwise one after another on the calling thread.
+  Vocabs(Ptr<Options> options, std::vector<std::shared_ptr<AlignedMemory>>&& vocabMemories, bool concurrently = false)
+      : options_(options) {
+    std::launch policy = concurrently ? std::launch::async : std::launch::deferred;
     if (!vocabMemories.empty()) {
       // load vocabs from buffer
-      load(std::move(vocabMemories));
+      load(std::move(vocabMemories), policy);
     } else {
       // load vocabs from file
       auto vocabPaths = options->get<std::vector<std::string>>("vocabs");
-      load(vocabPaths);
+      load(vocabPaths, policy);
     }
   }
 
@@ -31,7 +36,7 @@ class Vocabs {
   Ptr<Options> options_;
 
   // load from buffer
-  void load(std::vector<std::shared_ptr<AlignedMemory>>&& vocabMemories) {
+  void load(std::vector<std::shared_ptr<AlignedMemory>>&& vocabMemories, std::launch policy) {
     // At least two vocabs: src and trg
     ABORT_IF(vocabMemories.size() < 2, "Insufficient number of vocabularies.");
     srcVocabs_.resize(vocabMemories.size());
@@ -39,33 +44,45 @@ class Vocabs {
     // loading vocabs (either from buffers or files) is the biggest bottleneck of the speed
     // uintptr_t holds unique keys (address) for share_ptr<AlignedMemory>
     std::unordered_map<uintptr_t, Ptr<Vocab>> vmap;
+    std::vector<std::future<void>> loads;
     for (size_t i = 0; i < srcVocabs_.size(); i++) {
       auto m = vmap.emplace(std::make_pair(reinterpret_cast<uintptr_t>(vocabMemories[i].get()), Ptr<Vocab>()));
       if (m.second) {  // new: load the vocab
-        m.first->second = New<Vocab>(options_, i);
-        m.first->second->loadFromSerialized(absl::string_view(vocabMemories[i]->begin(), vocabMemories[i]->size()));
+        Ptr<Vocab> vocab = m.first->second = New<Vocab>(options_, i);
+        const AlignedMemory& memory = *vocabMemories[i];
+        loads.push_back(std::async(policy, [vocab, &memory]() {
+          vocab->loadFromSerialized(absl::string_view(memory.begin(), memory.size()));
+        }));
       }
       srcVocabs_[i] = m.first->second;
     }
+    for (std::future<void>& load : loads) {
+      load.get();
+    }
     // Initialize target vocab
     trgVocab_ = srcVocabs_.back();
     srcVocabs_.pop_back();
   }
 
   // load from file
-  void load(const std::vector<std::string>& vocabPaths) {
+  void load(const std::vector<std::string>& vocabPaths, std::launch policy) {
     // with the current setup, we need at least two vocabs: src and trg
     ABORT_IF(vocabPaths.size() < 2, "Insufficient number of vocabularies.");
     srcVocabs_.resize(vocabPaths.size());
     std::unordered_map<std::string, Ptr<Vocab>> vmap;
+    std::vector<std::future<void>> loads;
     for (size_t i = 0; i < srcVocabs_.size(); ++i) {
       auto m = vmap.emplace(std::make_pair(vocabPaths[i], Ptr<Vocab>()));
       if (m.second) {  // new: load the vocab
-        m.first->second = New<Vocab>(options_, i);
-        m.first->second->load(vocabPaths[i]);
+        Ptr<Vocab> vocab = m.first->second = New<Vocab>(options_, i);
+        const std::string& path = vocabPaths[i];
+        loads.push_back(std::async(policy, [vocab, &path]() { vocab->load(path); }));
       }
       srcVocabs_[i] = m.first->second;
     }
+    for (std::future<void>& load : loads) {
+      load.get();
+    }
     // Initialize target vocab
     trgVocab_ = srcVocabs_.back();
     srcVocabs_.pop_back();